@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ansi.h"
+
+enum {
+  ANSI_TEXT,
+  ANSI_ESCAPE, /* Just saw ESC. */
+  ANSI_CSI, /* Inside ESC [ ... */
+  ANSI_OSC, /* Inside ESC ] ..., which ends with BEL or ESC \ */
+  ANSI_OSC_ESCAPE
+};
+
+static const uint32_t palette[16] = {
+  0x000000, 0xcd0000, 0x00cd00, 0xcdcd00, 0x0000ee, 0xcd00cd, 0x00cdcd, 0xe5e5e5,
+  0x7f7f7f, 0xff0000, 0x00ff00, 0xffff00, 0x5c5cff, 0xff00ff, 0x00ffff, 0xffffff
+};
+
+static void resetStyle(AnsiStyle *style) {
+  style->foreground = 0;
+  style->background = 0;
+  style->flags = 0;
+}
+
+void initAnsi(AnsiParser *parser) {
+  resetStyle(&parser->style);
+  parser->state = ANSI_TEXT;
+  parser->paramLength = 0;
+}
+
+uint64_t ansiStyleKey(const AnsiStyle *style) {
+  /* Colors take 25 bits each, which leaves room for the flags in one 64 bit key. */
+  return (uint64_t) style->foreground | ((uint64_t) style->background << 25) | ((uint64_t) style->flags << 50);
+}
+
+uint32_t ansiRGB(uint32_t color) {
+  if (color & ANSI_RGB) return color & 0xffffff;
+
+  int index = color - 1;
+  if (index < 16) return palette[index];
+  if (index < 232) { /* 6x6x6 color cube */
+    index -= 16;
+    int levels[6] = {0x00, 0x5f, 0x87, 0xaf, 0xd7, 0xff};
+    return (levels[index / 36] << 16) | (levels[(index / 6) % 6] << 8) | levels[index % 6];
+  }
+  int gray = 8 + (index - 232) * 10;
+  return (gray << 16) | (gray << 8) | gray;
+}
+
+static int splitParams(AnsiParser *parser, int *params, int max) {
+  /* Colons separate sub-parameters in some terminals; treating them like semicolons is close enough. */
+  int count = 0;
+  int value = 0;
+  bool hasValue = false;
+  for (size_t i = 0; i <= parser->paramLength && count < max; i++) {
+    char c = i < parser->paramLength ? parser->params[i] : ';';
+    if (c >= '0' && c <= '9') {
+      value = value * 10 + (c - '0');
+      hasValue = true;
+    } else if (c == ';' || c == ':') {
+      params[count++] = hasValue ? value : 0;
+      value = 0;
+      hasValue = false;
+    }
+  }
+  return count;
+}
+
+static void extendedColor(int *params, int count, int *i, uint32_t *color) {
+  /* 38;5;n picks from the palette, 38;2;r;g;b gives the color directly. */
+  if (*i + 2 < count && params[*i + 1] == 5) {
+    *color = (params[*i + 2] & 0xff) + 1;
+    *i += 2;
+  } else if (*i + 4 < count && params[*i + 1] == 2) {
+    *color = ANSI_RGB | ((params[*i + 2] & 0xff) << 16) | ((params[*i + 3] & 0xff) << 8) | (params[*i + 4] & 0xff);
+    *i += 4;
+  }
+}
+
+static void applySGR(AnsiParser *parser) {
+  int params[32];
+  int count = splitParams(parser, params, 32);
+  AnsiStyle *style = &parser->style;
+
+  for (int i = 0; i < count; i++) {
+    int p = params[i];
+    if (p == 0) resetStyle(style);
+    else if (p == 1) style->flags |= ANSI_BOLD;
+    else if (p == 3) style->flags |= ANSI_ITALIC;
+    else if (p == 4) style->flags |= ANSI_UNDERLINE;
+    else if (p == 7) style->flags |= ANSI_INVERSE;
+    else if (p == 22) style->flags &= ~ANSI_BOLD;
+    else if (p == 23) style->flags &= ~ANSI_ITALIC;
+    else if (p == 24) style->flags &= ~ANSI_UNDERLINE;
+    else if (p == 27) style->flags &= ~ANSI_INVERSE;
+    else if (p >= 30 && p <= 37) style->foreground = p - 30 + 1;
+    else if (p == 38) extendedColor(params, count, &i, &style->foreground);
+    else if (p == 39) style->foreground = 0;
+    else if (p >= 40 && p <= 47) style->background = p - 40 + 1;
+    else if (p == 48) extendedColor(params, count, &i, &style->background);
+    else if (p == 49) style->background = 0;
+    else if (p >= 90 && p <= 97) style->foreground = p - 90 + 8 + 1;
+    else if (p >= 100 && p <= 107) style->background = p - 100 + 8 + 1;
+  }
+}
+
+void ansiParse(AnsiParser *parser, const char *chars, size_t length, AnsiRunFunction run, void *data) {
+  const char *c = chars;
+  const char *end = chars + length;
+
+  while (c < end) {
+    switch (parser->state) {
+    case ANSI_TEXT: {
+      /* Plain text goes out in one piece up to the next escape, so uncolored output costs a single memchr. */
+      const char *escape = memchr(c, '\x1b', end - c);
+      const char *stop = escape == NULL ? end : escape;
+      if (stop > c) run(data, &parser->style, c, stop - c);
+      c = stop;
+      if (escape != NULL) {
+	parser->state = ANSI_ESCAPE;
+	c++;
+      }
+    } break;
+    case ANSI_ESCAPE: {
+      if (*c == '[') {
+	parser->state = ANSI_CSI;
+	parser->paramLength = 0;
+      } else if (*c == ']') {
+	parser->state = ANSI_OSC;
+      } else {
+	parser->state = ANSI_TEXT; /* Two character escapes carry nothing we can show. */
+      }
+      c++;
+    } break;
+    case ANSI_CSI: {
+      unsigned char byte = *c++;
+      if (byte >= 0x40 && byte <= 0x7e) {
+	if (byte == 'm') applySGR(parser); /* Everything else moves a cursor we don't have. */
+	parser->state = ANSI_TEXT;
+      } else if (parser->paramLength < sizeof(parser->params)) {
+	parser->params[parser->paramLength++] = byte;
+      }
+    } break;
+    case ANSI_OSC: {
+      char byte = *c++;
+      if (byte == '\a') parser->state = ANSI_TEXT;
+      else if (byte == '\x1b') parser->state = ANSI_OSC_ESCAPE;
+    } break;
+    case ANSI_OSC_ESCAPE: {
+      parser->state = (*c++ == '\\') ? ANSI_TEXT : ANSI_OSC;
+    } break;
+    }
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef SGIDLS_ANSI
+#define SGIDLS_ANSI
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ANSI_BOLD 1
+#define ANSI_ITALIC 2
+#define ANSI_UNDERLINE 4
+#define ANSI_INVERSE 8
+
+#define ANSI_RGB 0x1000000 /* Set on colors given as 24 bit RGB rather than from the palette. */
+
+typedef struct {
+  uint32_t foreground; /* 0 for the default color, palette index + 1, or ANSI_RGB | 0xRRGGBB. */
+  uint32_t background;
+  uint8_t flags;
+} AnsiStyle;
+
+typedef struct {
+  AnsiStyle style;
+  int state;
+  char params[64]; /* Parameters of an escape sequence, which may arrive split across chunks. */
+  size_t paramLength;
+} AnsiParser;
+
+/* Called once for every run of text that shares a style. The text points into the chunk being parsed. */
+typedef void (*AnsiRunFunction)(void *data, const AnsiStyle *style, const char *chars, size_t length);
+
+extern void initAnsi(AnsiParser *parser);
+extern void ansiParse(AnsiParser *parser, const char *chars, size_t length, AnsiRunFunction run, void *data);
+extern uint64_t ansiStyleKey(const AnsiStyle *style);
+extern uint32_t ansiRGB(uint32_t color);
+
+#endif
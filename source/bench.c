@@ -0,0 +1,220 @@
+/* Console throughput without a display. Pushes synthetic command output through each stage of the
+   output path on its own and reports how fast it goes. Run with 'make bench'. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "ansi.h"
+#include "config.h"
+#include "sink.h"
+#include "spool.h"
+#include "utf8.h"
+
+#define BENCH_SIZE (32 * 1024 * 1024) /* Bytes of output in each workload. */
+#define BENCH_SECONDS 0.5 /* Each stage repeats until it has run at least this long. */
+
+typedef struct {
+  const char *name;
+  char *chars;
+  size_t length;
+  size_t lines;
+} Workload;
+
+typedef struct {
+  const char *name;
+  void (*run)(Workload *workload); /* One full pass over the workload. */
+} Stage;
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/* Workloads */
+
+static void fill(Workload *workload, const char *name, const char *(*line)(size_t number, size_t *length)) {
+  workload->name = name;
+  workload->chars = malloc(BENCH_SIZE);
+  if (workload->chars == NULL) {
+    fprintf(stderr, "Ran out of memory making benchmark output.\n");
+    exit(1);
+  }
+  workload->length = 0;
+  workload->lines = 0;
+  for (size_t number = 0; ; number++) {
+    size_t length;
+    const char *chars = line(number, &length);
+    if (workload->length + length > BENCH_SIZE) break;
+    memcpy(workload->chars + workload->length, chars, length);
+    workload->length += length;
+    workload->lines++;
+  }
+}
+
+static char lineBuffer[8 * 1024 * 1024 + 1];
+
+static const char *shortLine(size_t number, size_t *length) {
+  *length = snprintf(lineBuffer, sizeof(lineBuffer), "%08zu compiling module number %zu\n", number, number % 977);
+  return lineBuffer;
+}
+
+static const char *hugeLine(size_t number, size_t *length) {
+  /* A minified file or a base64 blob, with nowhere to break it. */
+  *length = sizeof(lineBuffer);
+  for (size_t i = 0; i < *length - 1; i++) lineBuffer[i] = 'A' + (i * 7 + number) % 26;
+  lineBuffer[*length - 1] = '\n';
+  return lineBuffer;
+}
+
+static const char *coloredLine(size_t number, size_t *length) {
+  *length = snprintf(lineBuffer, sizeof(lineBuffer), "\x1b[32mPASS\x1b[0m test_%zu \x1b[1;33m%zu warnings\x1b[0m \x1b[38;2;128;128;255m%zums\x1b[0m\n",
+                     number, number % 5, number % 300);
+  return lineBuffer;
+}
+
+static const char *latin1Line(size_t number, size_t *length) {
+  /* Not UTF-8, so every accented letter needs repairing. */
+  *length = snprintf(lineBuffer, sizeof(lineBuffer), "caf\xe9 na\xefve r\xe9sum\xe9 \xe0 la carte %zu\n", number);
+  return lineBuffer;
+}
+
+/* Stages, each fed the workload in the chunks a job reads */
+
+static void feed(Workload *workload, void (*write)(void *data, const char *chars, size_t length), void *data) {
+  for (size_t offset = 0; offset < workload->length; offset += JOB_READ_SIZE) {
+    size_t length = workload->length - offset < JOB_READ_SIZE ? workload->length - offset : JOB_READ_SIZE;
+    write(data, workload->chars + offset, length);
+  }
+}
+
+static void readPipe(Workload *workload) {
+  /* The chunked reader: the output comes through a pipe from another process, as it does from a command. */
+  int ends[2];
+  if (pipe(ends) == -1) {
+    perror("pipe");
+    exit(1);
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(ends[0]);
+    for (size_t written = 0; written < workload->length; ) {
+      ssize_t result = write(ends[1], workload->chars + written, workload->length - written);
+      if (result <= 0) _exit(1);
+      written += result;
+    }
+    _exit(0);
+  }
+  close(ends[1]);
+  static char chunk[JOB_READ_SIZE];
+  while (read(ends[0], chunk, sizeof(chunk)) > 0);
+  close(ends[0]);
+  waitpid(pid, NULL, 0);
+}
+
+static void utf8Write(void *data, const char *chars, size_t length) {
+  size_t repairedLength;
+  utf8Repair(data, chars, length, &repairedLength);
+}
+
+static void repairUtf8(Workload *workload) {
+  Utf8Repair repair;
+  initUtf8(&repair);
+  feed(workload, utf8Write, &repair);
+  freeUtf8(&repair);
+}
+
+static void ignoreRun(void *data, const AnsiStyle *style, const char *chars, size_t length) {
+}
+
+static void ansiWrite(void *data, const char *chars, size_t length) {
+  ansiParse(data, chars, length, ignoreRun, NULL);
+}
+
+static void parseAnsi(Workload *workload) {
+  AnsiParser parser;
+  initAnsi(&parser);
+  feed(workload, ansiWrite, &parser);
+}
+
+static void pipelineWriteOutput(void *data, const char *chars, size_t length) {
+  pipelineWrite(data, chars, length, false);
+}
+
+static void runPipeline(Workload *workload, Sink sink) {
+  Pipeline pipeline;
+  initPipeline(&pipeline, sink);
+  feed(workload, pipelineWriteOutput, &pipeline);
+  pipelineFlush(&pipeline);
+  freeUtf8(&pipeline.outputUtf8);
+  freeUtf8(&pipeline.errorUtf8);
+}
+
+static void intoNull(Workload *workload) {
+  runPipeline(workload, nullSink());
+}
+
+static MemorySink memory;
+static Sink memoryOutput;
+
+static void intoMemory(Workload *workload) {
+  clearMemorySink(&memory);
+  runPipeline(workload, memoryOutput);
+}
+
+static Spool spool;
+
+static void intoSpool(Workload *workload) {
+  clearSpool(&spool);
+  runPipeline(workload, spoolSink(&spool));
+}
+
+static void measure(Workload *workload, Stage *stage) {
+  int passes = 0;
+  double start = now();
+  double elapsed;
+  do {
+    stage->run(workload);
+    passes++;
+    elapsed = now() - start;
+  } while (elapsed < BENCH_SECONDS);
+
+  printf("%-12s %-14s %10.1f %14.0f\n", workload->name, stage->name,
+         workload->length * passes / elapsed / (1024 * 1024), workload->lines * passes / elapsed);
+}
+
+int main() {
+  Workload workloads[4];
+  fill(&workloads[0], "short lines", shortLine);
+  fill(&workloads[1], "huge lines", hugeLine);
+  fill(&workloads[2], "colored", coloredLine);
+  fill(&workloads[3], "latin-1", latin1Line);
+
+  Stage stages[] = {
+    {"pipe read", readPipe},
+    {"utf8 repair", repairUtf8},
+    {"ansi parse", parseAnsi},
+    {"null sink", intoNull},
+    {"memory sink", intoMemory},
+    {"spool sink", intoSpool},
+  };
+
+  memoryOutput = memorySink(&memory);
+  initSpool(&spool);
+
+  printf("%-12s %-14s %10s %14s\n", "workload", "stage", "MB/s", "lines/s");
+  for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+    for (size_t s = 0; s < sizeof(stages) / sizeof(stages[0]); s++) measure(&workloads[w], &stages[s]);
+    free(workloads[w].chars);
+  }
+
+  clearSpool(&spool);
+  free(memory.chars);
+  return 0;
+}
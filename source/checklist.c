@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <gtk/gtk.h>
+
+#include "common.h"
+#include "checklist.h"
+#include "job.h"
+#include "latency.h"
+#include "table.h"
+
+typedef struct {
+  GtkTreeIter iter; /* List store iters stay valid for as long as the row exists. */
+  unsigned generation;
+} Item;
+
+static Checklist *checklists = NULL;
+
+static void updateChecked(Checklist *checklist) {
+  GString *value = g_string_new(NULL);
+  GtkTreeModel *model = GTK_TREE_MODEL(checklist->store);
+  GtkTreeIter iter;
+
+  bool valid = gtk_tree_model_get_iter_first(model, &iter);
+  while (valid) {
+    gboolean checked;
+    char *item;
+    gtk_tree_model_get(model, &iter, 0, &checked, 1, &item, -1);
+    if (checked) {
+      if (value->len > 0) g_string_append(value, checklist->separator);
+      g_string_append(value, item);
+    }
+    g_free(item);
+    valid = gtk_tree_model_iter_next(model, &iter);
+  }
+
+  usePanel(checklist->command->panel);
+  char *previous = checklist->value;
+  checklist->value = g_string_free(value, false);
+  setVariable(checklist->variable, checklist->value);
+  g_free(previous);
+}
+
+static void itemToggled(GtkCellRendererToggle *renderer, gchar *path, gpointer data) {
+  Checklist *checklist = data;
+  GtkTreeIter iter;
+  if (!gtk_tree_model_get_iter_from_string(GTK_TREE_MODEL(checklist->store), &iter, path)) return;
+
+  enterHandler("itemToggled", checklist->variable);
+  gboolean checked;
+  gtk_tree_model_get(GTK_TREE_MODEL(checklist->store), &iter, 0, &checked, -1);
+  gtk_list_store_set(checklist->store, &iter, 0, !checked, -1);
+  updateChecked(checklist);
+  leaveHandler();
+}
+
+static void addItem(Checklist *checklist, const char *chars, size_t length) {
+  if (length > 0 && chars[length - 1] == '\r') length--;
+  if (length == 0) return;
+
+  char *key = g_strndup(chars, length);
+  Item *item = g_hash_table_lookup(checklist->items, key);
+  if (item != NULL) {
+    /* Already listed, so it keeps its row and its check. */
+    item->generation = checklist->generation;
+    g_free(key);
+    return;
+  }
+
+  item = allocate(sizeof(Item), "Ran out of memory adding checklist item.");
+  item->generation = checklist->generation;
+  gtk_list_store_insert_with_values(checklist->store, &item->iter, -1, 0, false, 1, key, -1);
+  g_hash_table_insert(checklist->items, key, item);
+}
+
+static void readItems(void *data, const char *chars, size_t length) {
+  /* Each chunk read from the command goes in as one batch, with no redraw until we return to the main loop. */
+  Checklist *checklist = data;
+  const char *end = chars + length;
+
+  while (chars < end) {
+    const char *newline = memchr(chars, '\n', end - chars);
+    if (newline == NULL) {
+      g_string_append_len(checklist->partial, chars, end - chars);
+      return;
+    }
+
+    if (checklist->partial->len > 0) {
+      g_string_append_len(checklist->partial, chars, newline - chars);
+      addItem(checklist, checklist->partial->str, checklist->partial->len);
+      g_string_truncate(checklist->partial, 0);
+    } else {
+      addItem(checklist, chars, newline - chars);
+    }
+    chars = newline + 1;
+  }
+}
+
+static void finishItems(void *data) {
+  Checklist *checklist = data;
+  if (checklist->partial->len > 0) {
+    addItem(checklist, checklist->partial->str, checklist->partial->len);
+    g_string_truncate(checklist->partial, 0);
+  }
+
+  /* Whatever the command didn't print this time is gone. */
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, checklist->items);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    Item *item = value;
+    if (item->generation == checklist->generation) continue;
+    gtk_list_store_remove(checklist->store, &item->iter);
+    g_hash_table_iter_remove(&iter);
+  }
+
+  checklist->running = false;
+  updateChecked(checklist);
+}
+
+static void runEnded(void *data, bool success) {
+  Checklist *checklist = data;
+  checklist->running = false;
+}
+
+void refreshChecklist(Checklist *checklist) {
+  if (checklist->running) return; /* The run in progress will bring it up to date. */
+  checklist->generation++;
+  /* Past the concurrency policy like a workflow step, running already keeps it to one run at a time. */
+  checklist->running = runStep(checklist->command, &checklist->watcher);
+}
+
+static void refreshClicked(GtkWidget *widget, gpointer data) {
+  Checklist *checklist = data;
+  enterHandler("refreshClicked", buttonSubject(widget, checklist->variable));
+  refreshChecklist(checklist);
+  leaveHandler();
+}
+
+Checklist *newChecklist(Command *command, char *variable, char *separator) {
+  Checklist *checklist = allocate(sizeof(Checklist), "Ran out of memory creating checklist.");
+  checklist->command = command;
+  checklist->reader.write = readItems;
+  checklist->reader.finish = finishItems;
+  checklist->reader.data = checklist;
+  command->reader = &checklist->reader;
+  checklist->watcher = (JobWatcher) {runEnded, checklist};
+  checklist->running = false;
+  checklist->items = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+  checklist->generation = 0;
+  checklist->partial = g_string_new(NULL);
+  checklist->variable = variable;
+  checklist->separator = separator == NULL ? " " : separator;
+  checklist->value = NULL;
+  checklist->next = checklists;
+  checklists = checklist;
+
+  checklist->store = gtk_list_store_new(2, G_TYPE_BOOLEAN, G_TYPE_STRING);
+  checklist->view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(checklist->store));
+  g_object_unref(checklist->store);
+  gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(checklist->view), false);
+
+  /* Fixed height rows let GTK skip measuring every item, which is what keeps thousands of them cheap. */
+  GtkCellRenderer *toggle = gtk_cell_renderer_toggle_new();
+  g_signal_connect(toggle, "toggled", G_CALLBACK(itemToggled), checklist);
+  GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes(NULL, toggle, "active", 0, NULL);
+  gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width(column, 32);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(checklist->view), column);
+
+  column = gtk_tree_view_column_new_with_attributes(NULL, gtk_cell_renderer_text_new(), "text", 1, NULL);
+  gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(checklist->view), column);
+  gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(checklist->view), true);
+
+  GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
+  gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+  gtk_scrolled_window_set_min_content_height(GTK_SCROLLED_WINDOW(scrolled), 150);
+  gtk_container_add(GTK_CONTAINER(scrolled), checklist->view);
+
+  GtkWidget *refresh = gtk_button_new_with_label("Refresh");
+  g_signal_connect(refresh, "clicked", G_CALLBACK(refreshClicked), checklist);
+
+  checklist->widget = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
+  gtk_box_pack_start(GTK_BOX(checklist->widget), scrolled, true, true, 0);
+  gtk_box_pack_start(GTK_BOX(checklist->widget), refresh, false, false, 0);
+  return checklist;
+}
+
+void freePanelChecklists(Panel *panel) {
+  /* Before the panel's commands go, they say which panel a checklist belongs to. A refresh still running
+     holds the panel, so by now nothing will call back into one. */
+  Checklist **link = &checklists;
+  while (*link != NULL) {
+    Checklist *checklist = *link;
+    if (checklist->command->panel != panel) {
+      link = &checklist->next;
+      continue;
+    }
+    *link = checklist->next;
+    g_hash_table_destroy(checklist->items);
+    g_string_free(checklist->partial, true);
+    g_free(checklist->value);
+    free(checklist);
+  }
+}
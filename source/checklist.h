@@ -0,0 +1,37 @@
+#ifndef SGIDLS_CHECKLIST
+#define SGIDLS_CHECKLIST
+
+#include <stdbool.h>
+#include <gtk/gtk.h>
+
+#include "job.h"
+
+typedef struct Checklist Checklist;
+
+/* A checklist whose items are the lines a command prints. Checked items are joined into a variable. */
+struct Checklist {
+  GtkWidget *widget; /* The outermost widget, what gets packed into the parent. */
+  GtkWidget *view;
+  GtkListStore *store; /* Column 0 is the check, column 1 the item. */
+
+  Command *command;
+  Reader reader;
+  JobWatcher watcher; /* Ends the refresh however the run goes, finishItems isn't called for a run that never starts. */
+  bool running;
+
+  GHashTable *items; /* Item text to its row, so a refresh only touches the rows that changed. */
+  unsigned generation; /* Bumped on every run, rows not seen in the latest run are removed when it ends. */
+  GString *partial; /* Unterminated trailing line, carried over to the next chunk. */
+
+  char *variable;
+  char *separator; /* Goes between checked items in the variable. */
+  char *value; /* What the variable is currently set to, ours to free. */
+
+  Checklist *next; /* Every checklist of a panel that hasn't been freed. */
+};
+
+extern Checklist *newChecklist(Command *command, char *variable, char *separator);
+extern void freePanelChecklists(Panel *panel);
+extern void refreshChecklist(Checklist *checklist);
+
+#endif
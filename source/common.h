@@ -6,12 +6,11 @@
 #include <gtk/gtk.h>
 
 extern void runCommand(GtkWidget *widget, gpointer data);
-extern void toggleCommand(GtkWidget *widget, gpointer key);
-extern void toggleWidget(GtkWidget *widget, gpointer name);
-extern void updateVariable(GtkEntryBuffer *text, guint position, gchar *chars, guint n_chars, gpointer key);
-extern void updateConsoleVariable(GObject *text, GParamSpec *pspec, gpointer key);
-
-extern GtkTextBuffer *shell_buffer;
+extern void toggleCommand(GtkWidget *widget, gpointer data);
+extern void toggleWidget(GtkWidget *widget, gpointer data);
+extern void updateVariable(GtkEditable *editable, gpointer data);
+extern void updateConsoleVariable(GObject *text, GParamSpec *pspec, gpointer data);
+extern void updateTableVariable(GtkTreeSelection *selection, gpointer data);
 
 static inline void *allocate(size_t size, char *err_message) {
   void *result = malloc(size);
@@ -0,0 +1,207 @@
+#define _GNU_SOURCE /* qsort_r */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <gtk/gtk.h>
+
+#include "common.h"
+#include "completion.h"
+#include "config.h"
+#include "job.h"
+#include "latency.h"
+#include "table.h"
+
+/* What the sorting thread works on. It owns all of it until it hands the index back. */
+typedef struct {
+  Completion *completion;
+  char *chars;
+  size_t *offsets;
+  size_t count;
+} Index;
+
+static Completion *completions = NULL;
+
+static int compareCandidates(const void *a, const void *b, void *data) {
+  const char *chars = data;
+  return strcmp(chars + *(const size_t *) a, chars + *(const size_t *) b);
+}
+
+static void buildIndex(GTask *task, gpointer source, gpointer data, GCancellable *cancellable) {
+  Index *index = data;
+  if (index->count == 0) {
+    g_task_return_boolean(task, true);
+    return;
+  }
+
+  qsort_r(index->offsets, index->count, sizeof(size_t), compareCandidates, index->chars);
+
+  size_t kept = 1;
+  for (size_t i = 1; i < index->count; i++) {
+    if (strcmp(index->chars + index->offsets[i], index->chars + index->offsets[kept - 1]) != 0) {
+      index->offsets[kept++] = index->offsets[i];
+    }
+  }
+  index->count = kept;
+  g_task_return_boolean(task, true);
+}
+
+static size_t lowerBound(Completion *completion, const char *prefix) {
+  /* First candidate that sorts at or after the prefix. Every candidate starting with the prefix follows it directly. */
+  size_t low = 0;
+  size_t high = completion->count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (strcmp(completion->chars + completion->offsets[middle], prefix) < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+static void showMatches(Completion *completion) {
+  gtk_list_store_clear(completion->store);
+
+  const char *prefix = gtk_entry_get_text(GTK_ENTRY(completion->entry));
+  size_t length = strlen(prefix);
+  if (length == 0) return;
+
+  size_t shown = 0;
+  for (size_t i = lowerBound(completion, prefix); i < completion->count && shown < COMPLETION_LIMIT; i++, shown++) {
+    const char *candidate = completion->chars + completion->offsets[i];
+    if (strncmp(candidate, prefix, length) != 0) break;
+    gtk_list_store_insert_with_values(completion->store, NULL, -1, 0, candidate, -1);
+  }
+}
+
+static void textChanged(GtkEditable *editable, gpointer data) {
+  enterHandler("textChanged", gtk_entry_get_text(GTK_ENTRY(editable)));
+  showMatches(data);
+  leaveHandler();
+}
+
+static gboolean matchAll(GtkEntryCompletion *entryCompletion, const gchar *key, GtkTreeIter *iter, gpointer data) {
+  return true; /* The store only ever holds matches, so GTK has nothing left to filter. */
+}
+
+static void indexBuilt(GObject *source, GAsyncResult *result, gpointer data) {
+  Index *index = g_task_get_task_data(G_TASK(result));
+  Completion *completion = index->completion;
+
+  if (!panelClosed(completion->command->panel)) {
+    g_free(completion->chars);
+    g_free(completion->offsets);
+    completion->chars = index->chars;
+    completion->offsets = index->offsets;
+    completion->count = index->count;
+    showMatches(completion);
+  } else {
+    g_free(index->chars);
+    g_free(index->offsets);
+  }
+  releasePanel(completion->command->panel);
+  free(index);
+}
+
+static void endLine(Completion *completion, size_t end) {
+  /* Drops a carriage return and skips empty lines, the NUL stays behind either way. */
+  if (end > completion->lineStart && completion->loading->str[end - 1] == '\r') completion->loading->str[end - 1] = '\0';
+  if (completion->loading->str[completion->lineStart] != '\0') {
+    g_array_append_val(completion->loadingOffsets, completion->lineStart);
+  }
+  completion->lineStart = end + 1;
+}
+
+static void readCandidates(void *data, const char *chars, size_t length) {
+  Completion *completion = data;
+  size_t from = completion->loading->len;
+  g_string_append_len(completion->loading, chars, length);
+
+  char *start = completion->loading->str + from;
+  char *end = completion->loading->str + completion->loading->len;
+  char *newline;
+  while ((newline = memchr(start, '\n', end - start)) != NULL) {
+    *newline = '\0';
+    endLine(completion, newline - completion->loading->str);
+    start = newline + 1;
+  }
+}
+
+static void finishCandidates(void *data) {
+  Completion *completion = data;
+  if (completion->loading->len > completion->lineStart) {
+    g_string_append_c(completion->loading, '\0');
+    endLine(completion, completion->loading->len - 1);
+  }
+
+  Index *index = allocate(sizeof(Index), "Ran out of memory indexing completions.");
+  index->completion = completion;
+  index->count = completion->loadingOffsets->len;
+  index->offsets = (size_t *) g_array_free(completion->loadingOffsets, false);
+  index->chars = g_string_free(completion->loading, false);
+  completion->loading = g_string_new(NULL);
+  completion->loadingOffsets = g_array_new(false, false, sizeof(size_t));
+  completion->lineStart = 0;
+
+  holdPanel(completion->command->panel); /* Its command is looked at once the index is built. */
+  GTask *task = g_task_new(NULL, NULL, indexBuilt, NULL);
+  g_task_set_task_data(task, index, NULL);
+  g_task_run_in_thread(task, buildIndex);
+  g_object_unref(task);
+}
+
+Completion *newCompletion(GtkWidget *entry, Command *command) {
+  Completion *completion = allocate(sizeof(Completion), "Ran out of memory creating completion.");
+  completion->entry = entry;
+  completion->command = command;
+  completion->reader.write = readCandidates;
+  completion->reader.finish = finishCandidates;
+  completion->reader.data = completion;
+  command->reader = &completion->reader;
+  completion->loading = g_string_new(NULL);
+  completion->loadingOffsets = g_array_new(false, false, sizeof(size_t));
+  completion->lineStart = 0;
+  completion->chars = NULL;
+  completion->offsets = NULL;
+  completion->count = 0;
+  completion->next = completions;
+  completions = completion;
+
+  /* Connected before the completion is attached, so the store is refilled before GTK looks at it. */
+  g_signal_connect(entry, "changed", G_CALLBACK(textChanged), completion);
+
+  completion->store = gtk_list_store_new(1, G_TYPE_STRING);
+  GtkEntryCompletion *entryCompletion = gtk_entry_completion_new();
+  gtk_entry_completion_set_model(entryCompletion, GTK_TREE_MODEL(completion->store));
+  g_object_unref(completion->store);
+  gtk_entry_completion_set_text_column(entryCompletion, 0);
+  gtk_entry_completion_set_match_func(entryCompletion, matchAll, NULL, NULL);
+  gtk_entry_set_completion(GTK_ENTRY(entry), entryCompletion);
+  g_object_unref(entryCompletion);
+
+  requestJob(command);
+  return completion;
+}
+
+void freePanelCompletions(Panel *panel) {
+  /* Before the panel's commands go, they say which panel a completion belongs to. An index still being built
+     holds the panel, so by now there is none. */
+  Completion **link = &completions;
+  while (*link != NULL) {
+    Completion *completion = *link;
+    if (completion->command->panel != panel) {
+      link = &completion->next;
+      continue;
+    }
+    *link = completion->next;
+    g_string_free(completion->loading, true);
+    g_array_free(completion->loadingOffsets, true);
+    g_free(completion->chars);
+    g_free(completion->offsets);
+    free(completion);
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef SGIDLS_COMPLETION
+#define SGIDLS_COMPLETION
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <gtk/gtk.h>
+
+#include "job.h"
+
+/* Completion for a textbox from the lines a command prints. The lines are sorted once, off the main thread,
+   so each keystroke only has to find where its prefix starts. */
+typedef struct Completion Completion;
+
+struct Completion {
+  GtkWidget *entry;
+  GtkListStore *store; /* Just the matches for what is typed now, never more than COMPLETION_LIMIT. */
+
+  Command *command;
+  Reader reader;
+
+  /* Candidates as they are read, each one ended by a NUL in place of its newline. */
+  GString *loading;
+  GArray *loadingOffsets;
+  size_t lineStart; /* Where the line being read starts in loading. */
+
+  /* The index, candidates sorted and without duplicates. */
+  char *chars;
+  size_t *offsets;
+  size_t count;
+
+  Completion *next; /* Every completion of a panel that hasn't been freed. */
+};
+
+extern Completion *newCompletion(GtkWidget *entry, Command *command);
+extern void freePanelCompletions(Panel *panel);
+
+#endif
@@ -3,4 +3,28 @@
 
 #define TABLE_MAX_LOAD_FACTOR 0.75
 
+#define SCANNER_CHUNK_SIZE 16384 /* Bytes read at a time from a description that comes down a pipe. */
+
+#define JOB_READ_SIZE 65536 /* Bytes read from a command's output per main loop iteration. */
+#define JOB_KILL_GRACE 5 /* Seconds a command gets to exit after SIGTERM before it gets SIGKILL. */
+#define JOB_LIMIT 16 /* Commands running at once unless --max-jobs says otherwise, the rest wait their turn. */
+
+#define CONSOLE_TABLE_COLUMNS 16 /* Fields past this many are left joined in the last column. */
+#define CONSOLE_COLUMN_WIDTH 120
+#define CONSOLE_REFRESH_INTERVAL 33 /* Milliseconds between redraws of a spool console, or batches of rows for a table, while output comes in. */
+#define CONSOLE_LINE_LIMIT 4096 /* Bytes of a single line a spool console will show. */
+
+#define SPOOL_MEMORY_LIMIT (4 * 1024 * 1024) /* Output past this many bytes moves to a temporary file. */
+#define SPOOL_INDEX_STRIDE 256 /* Lines between entries of a spool's line index. */
+
+#define COMPLETION_LIMIT 100 /* Matches offered for a textbox at once. */
+
+#define LATENCY_SLOW_HANDLER 20 /* Milliseconds a signal handler may take before it is reported. */
+#define LATENCY_HEARTBEAT 50 /* Milliseconds between the main loop checking in with the stall watchdog. */
+#define LATENCY_RING_SIZE 256 /* Reports kept, older ones are overwritten. */
+#define LATENCY_DEPTH 8 /* Handlers nested inside each other that are timed separately. */
+#define LATENCY_HANDLERS 16 /* Distinct handlers counted. */
+
+#define SAVE_CHUNK_SIZE (1024 * 1024) /* Bytes handed to each write when saving a console. */
+
 #endif
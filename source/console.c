@@ -0,0 +1,542 @@
+#define _GNU_SOURCE /* memmem, memrchr */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "config.h"
+#include "console.h"
+#include "latency.h"
+#include "search.h"
+#include "sink.h"
+#include "table.h"
+
+static void textRun(void *data, const AnsiStyle *style, const char *chars, size_t length, bool isError);
+static void tableRun(void *data, const AnsiStyle *style, const char *chars, size_t length, bool isError);
+
+static void addColumn(Console *console) {
+  int index = console->columns + 1; /* Column 0 of the store holds the raw line. */
+  char title[16];
+  snprintf(title, sizeof(title), "%d", index);
+
+  GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+  GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes(title, renderer, "text", index, NULL);
+  /* Fixed sizing lets the view run in fixed height mode, so it only ever measures the rows on screen. */
+  gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width(column, CONSOLE_COLUMN_WIDTH);
+  gtk_tree_view_column_set_resizable(column, true);
+  gtk_tree_view_column_set_sort_column_id(column, index);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(console->view), column);
+
+  console->columns++;
+}
+
+static GtkWidget *newScrolledWindow() {
+  GtkWidget *window = gtk_scrolled_window_new(NULL, NULL);
+  gtk_scrolled_window_set_min_content_height(GTK_SCROLLED_WINDOW(window), 200);
+  gtk_scrolled_window_set_min_content_width(GTK_SCROLLED_WINDOW(window), 200);
+  return window;
+}
+
+static Console *newTableConsole(Console *console) {
+  GType types[CONSOLE_TABLE_COLUMNS + 1];
+  for (int i = 0; i <= CONSOLE_TABLE_COLUMNS; i++) types[i] = G_TYPE_STRING;
+  console->store = gtk_list_store_newv(CONSOLE_TABLE_COLUMNS + 1, types);
+
+  console->widget = newScrolledWindow();
+  console->view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(console->store));
+  gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(console->view), true);
+  gtk_tree_view_set_enable_search(GTK_TREE_VIEW(console->view), false);
+  gtk_container_add(GTK_CONTAINER(console->widget), console->view);
+  return console;
+}
+
+static int lineHeight(GtkWidget *view) {
+  PangoContext *context = gtk_widget_get_pango_context(view);
+  PangoFontMetrics *metrics = pango_context_get_metrics(context, NULL, NULL);
+  int height = (pango_font_metrics_get_ascent(metrics) + pango_font_metrics_get_descent(metrics)) / PANGO_SCALE;
+  pango_font_metrics_unref(metrics);
+  return height > 0 ? height : 1;
+}
+
+static void renderSpool(Console *console) {
+  /* Only the window of lines under the scrollbar ever goes into the text buffer,
+     so the cost of a redraw doesn't depend on how much output there is. */
+  bool filtering = searchFiltering(console);
+  size_t total = filtering ? console->search->count : spoolLineCount(console->spool);
+  double value = gtk_adjustment_get_value(console->adjustment);
+  bool follow = value + gtk_adjustment_get_page_size(console->adjustment) >= gtk_adjustment_get_upper(console->adjustment);
+  if (follow) value = total > (size_t) console->rows ? total - console->rows : 0;
+
+  console->rendering = true;
+  gtk_adjustment_configure(console->adjustment, value, 0, total, 1, console->rows > 1 ? console->rows - 1 : 1, console->rows);
+  console->rendering = false;
+
+  size_t top = gtk_adjustment_get_value(console->adjustment);
+  GString *scratch = console->scratch;
+  g_string_truncate(scratch, 0);
+  for (size_t row = top; row < total && row < top + console->rows; row++) {
+    size_t line = filtering ? console->search->matches[row] : row;
+    size_t length;
+    const char *chars = spoolLine(console->spool, line, &length);
+    if (length > CONSOLE_LINE_LIMIT) {
+      length = CONSOLE_LINE_LIMIT;
+      while (length > 0 && (chars[length] & 0xC0) == 0x80) length--; /* Don't cut a character in half. */
+    }
+    if (row > top) g_string_append_c(scratch, '\n');
+    g_string_append_len(scratch, chars, length);
+  }
+  gtk_text_buffer_set_text(console->buffer, scratch->str, scratch->len);
+  if (console->search != NULL) searchRendered(console);
+}
+
+static gboolean refreshSpool(gpointer data) {
+  Console *console = data;
+  console->refresh = 0;
+  if (panelClosed(console->panel)) return G_SOURCE_REMOVE; /* Due before the console is freed, but the view is gone. */
+  renderSpool(console);
+  return G_SOURCE_REMOVE;
+}
+
+static void scheduleRefresh(Console *console) {
+  if (console->refresh == 0) console->refresh = g_timeout_add(CONSOLE_REFRESH_INTERVAL, refreshSpool, console);
+}
+
+static void scrollSpool(GtkAdjustment *adjustment, gpointer data) {
+  /* Set off by every redraw too, only a scroll from outside is timed and rendered. */
+  Console *console = data;
+  if (console->rendering) return;
+  enterHandler("scrollSpool", NULL);
+  renderSpool(console);
+  leaveHandler();
+}
+
+static void resizeSpool(GtkWidget *widget, GdkRectangle *allocation, gpointer data) {
+  Console *console = data;
+  enterHandler("resizeSpool", NULL);
+  int rows = allocation->height / lineHeight(console->view);
+  if (rows < 1) rows = 1;
+  if (rows != console->rows) {
+    console->rows = rows;
+    scheduleRefresh(console);
+  }
+  leaveHandler();
+}
+
+static gboolean wheelSpool(GtkWidget *widget, GdkEvent *event, gpointer data) {
+  Console *console = data;
+  enterHandler("wheelSpool", NULL);
+  GdkScrollDirection direction;
+  double dx, dy;
+  double delta = 0;
+
+  if (gdk_event_get_scroll_direction(event, &direction)) {
+    if (direction == GDK_SCROLL_UP) delta = -3;
+    if (direction == GDK_SCROLL_DOWN) delta = 3;
+  } else if (gdk_event_get_scroll_deltas(event, &dx, &dy)) {
+    delta = dy * 3;
+  }
+
+  double value = gtk_adjustment_get_value(console->adjustment);
+  gtk_adjustment_set_value(console->adjustment, value + delta);
+  leaveHandler();
+  return true;
+}
+
+static Console *newSpoolConsole(Console *console) {
+  console->spool = allocate(sizeof(Spool), "Ran out of memory creating console.");
+  initSpool(console->spool);
+  console->rows = 1;
+
+  console->buffer = gtk_text_buffer_new(NULL);
+  console->view = gtk_text_view_new_with_buffer(console->buffer);
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(console->view), false);
+  gtk_widget_add_events(console->view, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK);
+
+  /* The scrolled window only scrolls sideways, the scrollbar next to it moves through lines of the spool. */
+  GtkWidget *window = newScrolledWindow();
+  gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(window), GTK_POLICY_AUTOMATIC, GTK_POLICY_EXTERNAL);
+  gtk_container_add(GTK_CONTAINER(window), console->view);
+
+  console->adjustment = gtk_adjustment_new(0, 0, 0, 1, 1, 1);
+  GtkWidget *scrollbar = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, console->adjustment);
+
+  console->widget = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+  gtk_box_pack_start(GTK_BOX(console->widget), window, true, true, 0);
+  gtk_box_pack_start(GTK_BOX(console->widget), scrollbar, false, false, 0);
+
+  g_signal_connect(console->adjustment, "value-changed", G_CALLBACK(scrollSpool), console);
+  g_signal_connect(window, "size-allocate", G_CALLBACK(resizeSpool), console);
+  g_signal_connect(console->view, "scroll-event", G_CALLBACK(wheelSpool), console);
+  return console;
+}
+
+static Console *newTextConsole(Console *console) {
+  console->widget = newScrolledWindow();
+  console->buffer = gtk_text_buffer_new(NULL);
+  console->view = gtk_text_view_new_with_buffer(console->buffer);
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(console->view), false);
+  gtk_container_add(GTK_CONTAINER(console->widget), console->view);
+  console->errorTag = gtk_text_buffer_create_tag(console->buffer, "stderr", "foreground", "red", NULL);
+  console->tags = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+  return console;
+}
+
+static Sink consoleSink(Console *console) {
+  /* Every mode names its sink here, without a default, so a mode left out is a compiler warning
+     rather than a console writing into a text buffer it doesn't have. */
+  switch (console->mode) {
+  case CONSOLE_TEXT: return (Sink) {textRun, console};
+  case CONSOLE_TABLE: return (Sink) {tableRun, console};
+  case CONSOLE_SPOOL: return spoolSink(console->spool);
+  }
+  return nullSink();
+}
+
+static Console *consoles = NULL;
+
+Console *newConsole(ConsoleMode mode, char *separator) {
+  Console *console = allocate(sizeof(Console), "Ran out of memory creating console.");
+  console->mode = mode;
+  console->widget = NULL;
+  console->buffer = NULL;
+  console->spool = NULL;
+  console->adjustment = NULL;
+  console->rows = 0;
+  console->refresh = 0;
+  console->rendering = false;
+  console->view = NULL;
+  console->store = NULL;
+  console->separator = separator;
+  console->columns = 0;
+  console->pendingRows = g_string_new(NULL);
+  console->partial = g_string_new(NULL);
+  console->errorPartial = g_string_new(NULL);
+  initPipeline(&console->pipeline, nullSink()); /* The mode's own sink is put in once it is built. */
+  console->errorTag = NULL;
+  console->tags = NULL;
+  console->lastKey = 0;
+  console->lastTag = NULL;
+  console->scratch = g_string_new(NULL);
+  console->search = NULL;
+  console->panel = getPanel();
+  console->next = consoles;
+  consoles = console;
+
+  if (getDefaultConsole() == NULL) setDefaultConsole(console);
+
+  switch (mode) {
+  case CONSOLE_TABLE: newTableConsole(console); break;
+  case CONSOLE_SPOOL: newSpoolConsole(console); break;
+  case CONSOLE_TEXT: newTextConsole(console); break;
+  }
+  console->pipeline.sink = consoleSink(console);
+  return console;
+}
+
+Console *findConsole(const char *name) {
+  if (name == NULL) return getDefaultConsole();
+  return getConsole(name);
+}
+
+static bool isBlank(char c) {
+  return c == ' ' || c == '\t';
+}
+
+static int splitWhitespace(char *start, char *end, char **fields) {
+  int count = 0;
+  char *c = start;
+  while (c < end && isBlank(*c)) c++;
+
+  while (c < end) {
+    fields[count++] = c;
+    if (count == CONSOLE_TABLE_COLUMNS) break; /* The last column takes the rest of the line. */
+    while (c < end && !isBlank(*c)) c++;
+    if (c == end) break;
+    *c++ = '\0';
+    while (c < end && isBlank(*c)) c++;
+  }
+
+  return count;
+}
+
+static int splitSeparator(char *start, char *end, char *separator, char **fields) {
+  size_t length = strlen(separator);
+  int count = 0;
+  char *c = start;
+
+  while (true) {
+    fields[count++] = c;
+    if (count == CONSOLE_TABLE_COLUMNS) break;
+    char *next = memmem(c, end - c, separator, length);
+    if (next == NULL) break;
+    *next = '\0';
+    c = next + length;
+  }
+
+  return count;
+}
+
+static void appendRow(Console *console, const char *line, size_t length) {
+  if (length > 0 && line[length - 1] == '\r') length--;
+
+  /* The scratch string holds the untouched line, then a copy that gets cut into fields in place.
+     The store copies every value on insertion, so the GValues can point straight into it. */
+  GString *scratch = console->scratch;
+  g_string_truncate(scratch, 0);
+  g_string_append_len(scratch, line, length);
+  g_string_append_c(scratch, '\0');
+  g_string_append_len(scratch, line, length);
+
+  char *raw = scratch->str;
+  char *start = raw + length + 1;
+  char *end = start + length;
+
+  char *fields[CONSOLE_TABLE_COLUMNS];
+  int count = (console->separator == NULL) ?
+    splitWhitespace(start, end, fields) : splitSeparator(start, end, console->separator, fields);
+
+  while (console->columns < count) addColumn(console);
+
+  gint columns[CONSOLE_TABLE_COLUMNS + 1];
+  GValue values[CONSOLE_TABLE_COLUMNS + 1];
+  memset(values, 0, sizeof(values));
+
+  columns[0] = 0;
+  g_value_init(&values[0], G_TYPE_STRING);
+  g_value_set_static_string(&values[0], raw);
+  for (int i = 0; i < count; i++) {
+    columns[i + 1] = i + 1;
+    g_value_init(&values[i + 1], G_TYPE_STRING);
+    g_value_set_static_string(&values[i + 1], fields[i]);
+  }
+
+  gtk_list_store_insert_with_valuesv(console->store, NULL, -1, columns, values, count + 1);
+
+  for (int i = 0; i <= count; i++) g_value_unset(&values[i]);
+}
+
+void consoleFlushRows(Console *console) {
+  /* Every row inserted is signalled through the search's filter and sort models and redrawn, so a burst of output
+     is put in as one batch instead of a chunk at a time. */
+  GString *rows = console->pendingRows;
+  const char *c = rows->str;
+  const char *end = rows->str + rows->len;
+  const char *newline;
+  while ((newline = memchr(c, '\n', end - c)) != NULL) {
+    appendRow(console, c, newline - c);
+    c = newline + 1;
+  }
+  g_string_truncate(rows, 0);
+}
+
+static gboolean refreshTable(gpointer data) {
+  Console *console = data;
+  console->refresh = 0;
+  if (panelClosed(console->panel)) return G_SOURCE_REMOVE;
+  consoleFlushRows(console);
+  return G_SOURCE_REMOVE;
+}
+
+static void writeTable(Console *console, GString *partial, const char *chars, size_t length) {
+  const char *end = chars + length;
+  const char *last = memrchr(chars, '\n', length);
+  if (last == NULL) {
+    g_string_append_len(partial, chars, length);
+    return;
+  }
+
+  /* Lines never hold a newline, so the batch can keep them as they came. */
+  if (partial->len > 0) {
+    g_string_append_len(console->pendingRows, partial->str, partial->len);
+    g_string_truncate(partial, 0);
+  }
+  g_string_append_len(console->pendingRows, chars, last + 1 - chars);
+  g_string_append_len(partial, last + 1, end - last - 1);
+  if (console->refresh == 0) console->refresh = g_timeout_add(CONSOLE_REFRESH_INTERVAL, refreshTable, console);
+}
+
+void consoleClear(Console *console) {
+  g_string_truncate(console->partial, 0);
+  g_string_truncate(console->errorPartial, 0);
+  resetPipeline(&console->pipeline);
+
+  switch (console->mode) {
+  case CONSOLE_TEXT: gtk_text_buffer_set_text(console->buffer, "", -1); break;
+  case CONSOLE_TABLE: {
+    g_string_truncate(console->pendingRows, 0);
+    gtk_list_store_clear(console->store);
+  } break;
+  case CONSOLE_SPOOL: {
+    clearSpool(console->spool);
+    gtk_adjustment_set_value(console->adjustment, 0);
+    scheduleRefresh(console);
+  } break;
+  }
+
+  if (console->search != NULL) searchCleared(console);
+}
+
+static void setColor(GtkTextTag *tag, char *property, uint32_t color) {
+  uint32_t rgb = ansiRGB(color);
+  GdkRGBA rgba = {((rgb >> 16) & 0xff) / 255.0, ((rgb >> 8) & 0xff) / 255.0, (rgb & 0xff) / 255.0, 1.0};
+  g_object_set(tag, property, &rgba, NULL);
+}
+
+static GtkTextTag *newStyleTag(Console *console, const AnsiStyle *style) {
+  GtkTextTag *tag = gtk_text_tag_new(NULL);
+  uint32_t foreground = style->foreground;
+  uint32_t background = style->background;
+
+  if (style->flags & ANSI_INVERSE) { /* Defaults swap to black on white. */
+    foreground = style->background != 0 ? style->background : 1;
+    background = style->foreground != 0 ? style->foreground : 8;
+  }
+
+  if (foreground != 0) setColor(tag, "foreground-rgba", foreground);
+  if (background != 0) setColor(tag, "background-rgba", background);
+  if (style->flags & ANSI_BOLD) g_object_set(tag, "weight", PANGO_WEIGHT_BOLD, NULL);
+  if (style->flags & ANSI_ITALIC) g_object_set(tag, "style", PANGO_STYLE_ITALIC, NULL);
+  if (style->flags & ANSI_UNDERLINE) g_object_set(tag, "underline", PANGO_UNDERLINE_SINGLE, NULL);
+
+  gtk_text_tag_table_add(gtk_text_buffer_get_tag_table(console->buffer), tag);
+  g_object_unref(tag); /* The tag table holds on to it. */
+  return tag;
+}
+
+static GtkTextTag *styleTag(Console *console, const AnsiStyle *style) {
+  uint64_t key = ansiStyleKey(style);
+  if (key == 0) return NULL; /* Default style, no tag needed. */
+  if (key == console->lastKey) return console->lastTag;
+
+  GtkTextTag *tag = g_hash_table_lookup(console->tags, &key);
+  if (tag == NULL) {
+    tag = newStyleTag(console, style);
+    gint64 *stored = g_new(gint64, 1);
+    *stored = key;
+    g_hash_table_insert(console->tags, stored, tag);
+  }
+
+  console->lastKey = key;
+  console->lastTag = tag;
+  return tag;
+}
+
+static void textRun(void *data, const AnsiStyle *style, const char *chars, size_t length, bool isError) {
+  Console *console = data;
+  GtkTextTag *tag = styleTag(console, style);
+  GtkTextTag *errorTag = isError ? console->errorTag : NULL;
+  if (tag == NULL) {
+    tag = errorTag;
+    errorTag = NULL;
+  }
+
+  GtkTextIter iter;
+  gtk_text_buffer_get_end_iter(console->buffer, &iter);
+  if (tag == NULL) {
+    gtk_text_buffer_insert(console->buffer, &iter, chars, length);
+  } else {
+    gtk_text_buffer_insert_with_tags(console->buffer, &iter, chars, length, tag, errorTag, NULL);
+  }
+}
+
+/* Tables and spools can't show styles, so they just get the text with the escapes taken out. Spools use the plain spool sink. */
+static void tableRun(void *data, const AnsiStyle *style, const char *chars, size_t length, bool isError) {
+  Console *console = data;
+  writeTable(console, isError ? console->errorPartial : console->partial, chars, length);
+}
+
+static void writeStream(Console *console, const char *chars, size_t length, bool isError) {
+  pipelineWrite(&console->pipeline, chars, length, isError);
+
+  if (console->search != NULL) searchAppended(console);
+  if (console->mode == CONSOLE_SPOOL) scheduleRefresh(console);
+}
+
+void consoleWrite(Console *console, const char *chars, size_t length) {
+  writeStream(console, chars, length, false);
+}
+
+void consoleWriteError(Console *console, const char *chars, size_t length) {
+  writeStream(console, chars, length, true);
+}
+
+void consoleFlush(Console *console) {
+  pipelineFlush(&console->pipeline);
+  if (console->mode == CONSOLE_TABLE) {
+    consoleFlushRows(console);
+    if (console->partial->len > 0) appendRow(console, console->partial->str, console->partial->len);
+    if (console->errorPartial->len > 0) appendRow(console, console->errorPartial->str, console->errorPartial->len);
+  }
+  g_string_truncate(console->partial, 0);
+  g_string_truncate(console->errorPartial, 0);
+
+  if (console->search != NULL) searchFinished(console);
+  if (console->mode == CONSOLE_SPOOL) scheduleRefresh(console);
+}
+
+void consoleRefresh(Console *console) {
+  if (console->mode == CONSOLE_SPOOL) scheduleRefresh(console);
+}
+
+static void freeConsole(Console *console) {
+  /* Only once its panel is closed and its widgets are destroyed. The buffer and the store are the references
+     the console kept for itself, the rest went with the window. */
+  if (console->refresh != 0) g_source_remove(console->refresh);
+  if (console->search != NULL) freeSearch(console);
+  if (console->spool != NULL) freeSpool(console->spool);
+  if (console->buffer != NULL) g_object_unref(console->buffer);
+  if (console->store != NULL) g_object_unref(console->store);
+  if (console->tags != NULL) g_hash_table_destroy(console->tags);
+  g_string_free(console->pendingRows, true);
+  g_string_free(console->partial, true);
+  g_string_free(console->errorPartial, true);
+  g_string_free(console->scratch, true);
+  freePipeline(&console->pipeline);
+  free(console);
+}
+
+void freePanelConsoles(Panel *panel) {
+  Console **link = &consoles;
+  while (*link != NULL) {
+    Console *console = *link;
+    if (console->panel == panel) {
+      *link = console->next;
+      freeConsole(console);
+    } else {
+      link = &console->next;
+    }
+  }
+}
+
+void printConsoleStats(FILE *out) {
+  int number = 0;
+  for (Console *console = consoles; console != NULL; console = console->next, number++) {
+    if (panelClosed(console->panel)) continue;
+
+    size_t buffered = console->partial->allocated_len + console->errorPartial->allocated_len + console->scratch->allocated_len + console->pendingRows->allocated_len +
+      console->pipeline.outputUtf8.capacity + console->pipeline.errorUtf8.capacity;
+    switch (console->mode) {
+    case CONSOLE_TEXT:
+      fprintf(out, "  console %d (text): %d chars, %d lines, %u style tags",
+              number, gtk_text_buffer_get_char_count(console->buffer), gtk_text_buffer_get_line_count(console->buffer),
+              g_hash_table_size(console->tags));
+      break;
+    case CONSOLE_TABLE:
+      fprintf(out, "  console %d (table): %d rows, %d columns",
+              number, gtk_tree_model_iter_n_children(GTK_TREE_MODEL(console->store), NULL), console->columns);
+      break;
+    case CONSOLE_SPOOL: {
+      Spool *spool = console->spool;
+      fprintf(out, "  console %d (spool): %zu bytes %s, %zu lines, %zu index entries",
+              number, spool->size, spool->fd == -1 ? "in memory" : "in file", spoolLineCount(spool), spool->indexCount);
+    } break;
+    }
+    fprintf(out, ", %zu bytes of line buffers", buffered);
+    if (console->search != NULL) fprintf(out, ", %zu search matches", console->search->count);
+    fprintf(out, "\n");
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef SGIDLS_CONSOLE
+#define SGIDLS_CONSOLE
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <gtk/gtk.h>
+
+#include "ansi.h"
+#include "sink.h"
+#include "spool.h"
+
+typedef enum {
+  CONSOLE_TEXT, /* Plain text in a GtkTextView, the default. */
+  CONSOLE_TABLE, /* Lines split into the columns of a GtkTreeView. */
+  CONSOLE_SPOOL /* Output kept in a Spool, only the lines on screen are loaded into the view. */
+} ConsoleMode;
+
+typedef struct Search Search;
+typedef struct Panel Panel;
+typedef struct Console Console;
+
+struct Console {
+  ConsoleMode mode;
+  GtkWidget *widget; /* The outermost widget, what gets packed into the parent. */
+
+  /* Text and spool modes */
+  GtkTextBuffer *buffer;
+
+  /* Text mode */
+  GtkTextTag *errorTag;
+  GHashTable *tags; /* Tags for ANSI styles, keyed on ansiStyleKey, created the first time a style shows up. */
+  uint64_t lastKey; /* The most recent style, since runs mostly alternate between a couple of styles. */
+  GtkTextTag *lastTag;
+
+  /* Spool mode */
+  Spool *spool;
+  GtkAdjustment *adjustment; /* Measured in lines. */
+  int rows; /* Lines that fit on screen. */
+  bool rendering;
+
+  /* Table mode */
+  GtkWidget *view;
+  GtkListStore *store;
+  char *separator; /* NULL splits on runs of whitespace. */
+  int columns; /* Number of columns currently shown in the view. */
+  GString *pendingRows; /* Complete lines not in the store yet, each ending in a newline. They go in once a frame. */
+
+  guint refresh; /* Pending redraw of a spool or batch of rows for a table, 0 when there is none. */
+
+  GString *partial; /* Unterminated trailing line, carried over to the next chunk. */
+  GString *errorPartial; /* The same for stderr, so the two streams never splice into one row. */
+  Pipeline pipeline; /* Makes the output valid UTF-8 and takes out the escapes on the way to the widgets. */
+  GString *scratch; /* Reused when splitting a line into fields. */
+
+  Search *search; /* NULL unless the console has a search bar. */
+
+  Panel *panel; /* Once the panel is closed the widgets are gone, so the console is left alone. */
+  Console *next; /* Every console of a panel that hasn't been freed, for memory statistics. */
+};
+
+extern Console *newConsole(ConsoleMode mode, char *separator);
+extern Console *findConsole(const char *name);
+extern void consoleClear(Console *console);
+extern void consoleWrite(Console *console, const char *chars, size_t length);
+extern void consoleWriteError(Console *console, const char *chars, size_t length);
+extern void consoleFlush(Console *console);
+extern void consoleRefresh(Console *console);
+extern void consoleFlushRows(Console *console);
+extern void freePanelConsoles(Panel *panel);
+extern void printConsoleStats(FILE *out);
+
+#endif
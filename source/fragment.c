@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <gtk/gtk.h>
+
+#include "common.h"
+#include "fragment.h"
+#include "scanner.h"
+
+static GHashTable *fragments = NULL; /* Keyed on the resolved path. */
+
+static char *readSource(const char *path, off_t size) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) return NULL;
+
+  char *source = allocate(size + 1, "Ran out of memory loading included file.");
+  size_t bytesRead = fread(source, sizeof(char), size, file);
+  source[bytesRead] = '\0';
+
+  fclose(file);
+  return source;
+}
+
+static bool unchanged(Fragment *fragment, struct stat *info) {
+  return fragment->size == info->st_size &&
+    fragment->modified.tv_sec == info->st_mtim.tv_sec &&
+    fragment->modified.tv_nsec == info->st_mtim.tv_nsec;
+}
+
+static bool scanFragment(Fragment *fragment, struct stat *info) {
+  char *source = readSource(fragment->path, info->st_size);
+  if (source == NULL) return false;
+
+  free(fragment->source);
+  free(fragment->tokens);
+  fragment->source = source;
+  fragment->tokens = scanTokens(source, &fragment->count);
+  fragment->modified = info->st_mtim;
+  fragment->size = info->st_size;
+  return true;
+}
+
+Fragment *loadFragment(const char *name, const char *directory) {
+  /* Relative names are relative to the file doing the including, not to wherever we were started from. */
+  char *joined = g_path_is_absolute(name) ? g_strdup(name) : g_build_filename(directory, name, NULL);
+  char *path = realpath(joined, NULL);
+  g_free(joined);
+
+  struct stat info;
+  if (path == NULL || stat(path, &info) != 0) {
+    fprintf(stderr, "'%s' file could not be included.\n", name);
+    free(path);
+    return NULL;
+  }
+
+  if (fragments == NULL) fragments = g_hash_table_new(g_str_hash, g_str_equal);
+
+  Fragment *fragment = g_hash_table_lookup(fragments, path);
+  if (fragment != NULL) {
+    free(path);
+    /* A fragment in the middle of being parsed is handed back as is, the parser reports the cycle. */
+    if (fragment->including || unchanged(fragment, &info)) return fragment;
+  } else {
+    fragment = allocate(sizeof(Fragment), "Ran out of memory loading included file.");
+    fragment->path = path;
+    fragment->directory = g_path_get_dirname(path);
+    fragment->modified = (struct timespec) {0, 0};
+    fragment->size = -1; /* Never matches, so a file that failed to load is tried again next time. */
+    fragment->source = NULL;
+    fragment->tokens = NULL;
+    fragment->count = 0;
+    fragment->including = false;
+    g_hash_table_insert(fragments, fragment->path, fragment);
+  }
+
+  if (!scanFragment(fragment, &info)) {
+    fprintf(stderr, "'%s' file could not be included.\n", name);
+    return NULL;
+  }
+  return fragment;
+}
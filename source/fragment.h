@@ -0,0 +1,26 @@
+#ifndef SGIDLS_FRAGMENT
+#define SGIDLS_FRAGMENT
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "scanner.h"
+
+/* A file pulled in with 'include'. Its tokens are scanned once and kept for the life of the process,
+   so every window that includes it just walks the same array again. */
+typedef struct {
+  char *path; /* Resolved with realpath, so one file is one cache entry however it is named. */
+  char *directory; /* Where includes inside this file are resolved from. */
+  struct timespec modified;
+  off_t size;
+
+  char *source; /* The tokens point into this. */
+  Token *tokens;
+  int count;
+
+  bool including; /* Currently being parsed, so including it again would never end. */
+} Fragment;
+
+extern Fragment *loadFragment(const char *name, const char *directory);
+
+#endif
@@ -0,0 +1,764 @@
+#define _GNU_SOURCE /* pipe2 */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <glib-unix.h>
+
+#include "common.h"
+#include "config.h"
+#include "console.h"
+#include "job.h"
+#include "progress.h"
+#include "spawn.h"
+#include "strings.h"
+#include "table.h"
+#include "workflow.h"
+
+struct Job {
+  Panel *panel;
+  char *command; /* The expanded command line, for statistics. */
+  Console *console;
+  Console *errorConsole; /* Where stderr goes, usually the same console as stdout. */
+  Reader *reader;
+  Progress *progress;
+  Command *source; /* For its output variable and selector. */
+  JobWatcher *watcher; /* Told how the run went once it's finished, NULL when nobody's asking. */
+  GString *captured; /* Stdout so far when it goes to a variable, NULL otherwise. */
+  pid_t pid; /* 0 once the child has been reaped. */
+  pid_t group; /* The child leads its own process group, so killing it takes anything it started along. */
+  bool cancelled; /* Restarted, so whatever it still prints is thrown away. */
+  guint timer; /* Pending timeout or SIGKILL, 0 when there is none. */
+  const char *reason; /* Why we killed it, NULL if we didn't. */
+  int status; /* As wait returns it, once the child has been reaped. */
+  char *report; /* How it ended, shown once its output is done. NULL when there's nothing worth saying. */
+  int output; /* Read end of the stdout pipe, -1 once it hits end of file. */
+  int errors; /* Read end of the stderr pipe, likewise. */
+
+  int input; /* Write end of the child's stdin, -1 once everything is written. */
+  char *inputChars;
+  size_t inputLength;
+  size_t inputWritten;
+
+  Job *next; /* Running jobs are kept in a list, for statistics. */
+  Job *previous;
+};
+
+static Job *jobs = NULL;
+static Command *commands = NULL;
+
+/* Runs waiting for a free slot, oldest first. */
+typedef struct Pending Pending;
+struct Pending {
+  Command *command;
+  JobWatcher *watcher;
+  Pending *next;
+};
+
+static Pending *firstPending = NULL;
+static Pending *lastPending = NULL;
+static int children = 0; /* Started and not yet reaped, what the limit counts. */
+static int jobLimit = JOB_LIMIT;
+
+Command *newCommand(char *command) {
+  Command *result = allocate(sizeof(Command), "Ran out of memory creating command.");
+  result->panel = getPanel();
+  result->command = command;
+  result->console = NULL;
+  result->input = NULL;
+  result->errors = NULL;
+  result->reader = NULL;
+  result->progress = NULL;
+  result->output = NULL;
+  result->outputLine = 0;
+  result->outputField = 0;
+  result->outputSeparator = NULL;
+  result->timeout = 0;
+  result->maxMemory = 0;
+  result->maxCpu = 0;
+  result->after = NULL;
+  result->afterCount = 0;
+  result->concurrency = CONCURRENCY_PARALLEL;
+  result->running = 0;
+  result->queued = 0;
+  result->waiting = 0;
+  result->latest = NULL;
+  result->latestWorkflow = NULL;
+  result->next = commands;
+  commands = result;
+  return result;
+}
+
+void freePanelCommands(Panel *panel) {
+  /* Only once its panel is closed and no run of any of them is still running or queued. Their strings go with the panel's. */
+  Command **link = &commands;
+  while (*link != NULL) {
+    Command *command = *link;
+    if (command->panel == panel) {
+      *link = command->next;
+      free(command->after);
+      free(command);
+    } else {
+      link = &command->next;
+    }
+  }
+}
+
+static bool submitJob(Command *command, JobWatcher *watcher) {
+  /* Waiting runs go first, so a burst of clicks can't starve the queue. */
+  if (children < jobLimit && firstPending == NULL) return startJob(command, watcher);
+
+  Pending *pending = allocate(sizeof(Pending), "Ran out of memory queueing job.");
+  pending->command = command;
+  pending->watcher = watcher;
+  pending->next = NULL;
+  if (lastPending != NULL) lastPending->next = pending;
+  else firstPending = pending;
+  lastPending = pending;
+  command->queued++;
+  holdPanel(command->panel);
+  return true;
+}
+
+static void dispatchJobs() {
+  while (children < jobLimit && firstPending != NULL) {
+    Pending *pending = firstPending;
+    firstPending = pending->next;
+    if (firstPending == NULL) lastPending = NULL;
+    Command *command = pending->command;
+    JobWatcher *watcher = pending->watcher;
+    free(pending);
+
+    command->queued--;
+    bool started = !panelClosed(command->panel) && startJob(command, watcher);
+    if (!started && watcher != NULL) watcher->finish(watcher->data, false);
+    releasePanel(command->panel);
+  }
+}
+
+static bool launchCommand(Command *command) {
+  /* A button with prerequisites runs as a workflow, which counts as one run however many steps it has. */
+  if (command->afterCount == 0) return submitJob(command, NULL);
+  command->running++;
+  if (startWorkflow(command)) return true;
+  command->running--;
+  return false;
+}
+
+static void commandFinished(Command *command) {
+  if (command->waiting > 0 && command->running == 0 && command->queued == 0 && !panelClosed(command->panel)) {
+    command->waiting--;
+    launchCommand(command);
+  }
+}
+
+void workflowEnded(Command *command) {
+  command->running--;
+  commandFinished(command);
+}
+
+static gboolean escalateJob(gpointer data) {
+  Job *job = data;
+  job->timer = 0;
+  kill(-job->group, SIGKILL);
+  return G_SOURCE_REMOVE;
+}
+
+static void stopJob(Job *job, const char *reason) {
+  /* SIGTERM first so the command can clean up, SIGKILL if it's still around after the grace period. */
+  if (job->reason == NULL) job->reason = reason;
+  if (job->timer != 0) g_source_remove(job->timer);
+  kill(-job->group, SIGTERM);
+  job->timer = g_timeout_add_seconds(JOB_KILL_GRACE, escalateJob, job);
+}
+
+static gboolean timeoutJob(gpointer data) {
+  Job *job = data;
+  job->timer = 0;
+  stopJob(job, "timed out");
+  return G_SOURCE_REMOVE;
+}
+
+static void cancelJob(Job *job) {
+  job->cancelled = true;
+  stopJob(job, "restarted");
+}
+
+bool requestJob(Command *command) {
+  bool busy = command->running > 0 || command->queued > 0;
+  switch (command->concurrency) {
+  case CONCURRENCY_PARALLEL: break;
+  case CONCURRENCY_QUEUE:
+    if (busy) {
+      command->waiting++;
+      return true;
+    }
+    break;
+  case CONCURRENCY_DROP:
+    if (busy) return false;
+    break;
+  case CONCURRENCY_RESTART:
+    if (command->queued > 0) return true; /* Hasn't started yet, so it's already the fresh run. */
+    if (command->latestWorkflow != NULL) cancelWorkflow(command->latestWorkflow);
+    if (command->latest != NULL && !command->latest->cancelled) cancelJob(command->latest);
+    break;
+  }
+  return launchCommand(command);
+}
+
+bool runStep(Command *command, JobWatcher *watcher) {
+  /* Steps skip the concurrency policy, the workflow already decided this run should happen. So do checklist
+     refreshes, which keep to one run at a time on their own. */
+  return submitJob(command, watcher);
+}
+
+void cancelStep(JobWatcher *watcher) {
+  /* Kills the run reporting to the watcher, or takes it off the queue if it hasn't started yet. Either way the
+     watcher hears it failed. */
+  for (Job *job = jobs; job != NULL; job = job->next) {
+    if (job->watcher != watcher) continue;
+    if (!job->cancelled) cancelJob(job);
+    return;
+  }
+
+  Pending *previous = NULL;
+  for (Pending *pending = firstPending; pending != NULL; previous = pending, pending = pending->next) {
+    if (pending->watcher != watcher) continue;
+    if (previous != NULL) previous->next = pending->next;
+    else firstPending = pending->next;
+    if (lastPending == pending) lastPending = previous;
+    Command *command = pending->command;
+    free(pending);
+    command->queued--;
+    watcher->finish(watcher->data, false);
+    releasePanel(command->panel);
+    return;
+  }
+}
+
+void setJobLimit(int limit) {
+  jobLimit = limit;
+}
+
+static void finishJob(Job *job) {
+  /* A job is done once the child has exited, its output is drained and its input is written,
+     in whichever order those happen. */
+  if (job->pid == 0 && job->output == -1 && job->errors == -1 && job->input == -1) {
+    if (job->captured != NULL) g_string_free(job->captured, true); /* Never handed over, its panel closed or it was restarted first. */
+    if (job->previous != NULL) job->previous->next = job->next;
+    else jobs = job->next;
+    if (job->next != NULL) job->next->previous = job->previous;
+
+    if (job->timer != 0) g_source_remove(job->timer);
+    if (job->report != NULL && !job->cancelled && !panelClosed(job->panel)) {
+      Console *console = job->errorConsole != NULL ? job->errorConsole : job->console;
+      if (console != NULL) {
+        consoleWriteError(console, job->report, strlen(job->report));
+        consoleFlush(console);
+      } else {
+        fputs(job->report, stderr);
+      }
+    }
+
+    Command *command = job->source;
+    JobWatcher *watcher = job->watcher;
+    bool success = !job->cancelled && job->reason == NULL && WIFEXITED(job->status) && WEXITSTATUS(job->status) == 0;
+    command->running--;
+    if (command->latest == job) command->latest = NULL;
+    free(job->report);
+    free(job->inputChars);
+    free(job);
+    if (watcher != NULL) watcher->finish(watcher->data, success);
+    commandFinished(command);
+    releasePanel(command->panel); /* Last, the watcher may still be using the panel's commands. */
+  }
+}
+
+static gboolean writeJob(gint fd, GIOCondition condition, gpointer data) {
+  Job *job = data;
+
+  /* The pipe is non-blocking, so each call writes whatever fits and hands control back to the main loop. */
+  while (job->inputWritten < job->inputLength) {
+    ssize_t length = write(fd, job->inputChars + job->inputWritten, job->inputLength - job->inputWritten);
+    if (length == -1) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return G_SOURCE_CONTINUE;
+      break; /* EPIPE, the child isn't reading any more. */
+    }
+    job->inputWritten += length;
+  }
+
+  close(fd);
+  job->input = -1;
+  finishJob(job);
+  return G_SOURCE_REMOVE;
+}
+
+static bool readStream(Job *job, int fd, bool isError) {
+  char chunk[JOB_READ_SIZE];
+
+  ssize_t length = read(fd, chunk, sizeof(chunk));
+  if (length > 0) {
+    /* Keep draining so the child isn't blocked on a full pipe. */
+    if (panelClosed(job->panel) || job->cancelled) return true;
+    if (isError) {
+      consoleWriteError(job->errorConsole, chunk, length);
+      return true;
+    }
+    if (job->progress != NULL) progressWrite(job->progress, chunk, length);
+    if (job->captured != NULL) g_string_append_len(job->captured, chunk, length);
+    if (job->reader != NULL) {
+      job->reader->write(job->reader->data, chunk, length);
+    } else if (job->console != NULL) {
+      consoleWrite(job->console, chunk, length);
+    }
+    return true;
+  }
+  if (length == -1 && errno == EINTR) return true;
+
+  close(fd);
+  return false;
+}
+
+static bool isBlank(char c) {
+  return c == ' ' || c == '\t';
+}
+
+static char *selectLine(char *chars, char *end, int line, char **lineEnd) {
+  /* Lines count from 1. Past the last line selects nothing. */
+  for (int i = 1; i < line && chars < end; i++) {
+    char *newline = memchr(chars, '\n', end - chars);
+    chars = newline == NULL ? end : newline + 1;
+  }
+  char *newline = memchr(chars, '\n', end - chars);
+  *lineEnd = newline == NULL ? end : newline;
+  return chars;
+}
+
+static char *selectField(char *chars, char *end, int field, char *separator, char **fieldEnd) {
+  /* Fields count from 1, split on the separator or on runs of blanks like a table console. */
+  size_t separatorLength = separator == NULL ? 0 : strlen(separator);
+  for (int i = 1; chars < end; i++) {
+    char *next;
+    if (separator == NULL) {
+      while (chars < end && isBlank(*chars)) chars++;
+      next = chars;
+      while (next < end && !isBlank(*next)) next++;
+    } else {
+      next = memmem(chars, end - chars, separator, separatorLength);
+      if (next == NULL) next = end;
+    }
+
+    if (i == field) {
+      *fieldEnd = next;
+      return chars;
+    }
+    chars = next == end ? end : next + (separator == NULL ? 0 : separatorLength);
+  }
+  *fieldEnd = end;
+  return end;
+}
+
+static char *takeOutput(Job *job) {
+  /* Narrows the captured output down in place and hands the buffer over as is, so it is never copied. */
+  GString *captured = job->captured;
+  job->captured = NULL;
+
+  char *start = captured->str;
+  char *end = captured->str + captured->len;
+  if (job->source->outputLine > 0) start = selectLine(start, end, job->source->outputLine, &end);
+  if (end > start && end[-1] == '\r') end--;
+  if (job->source->outputField > 0) start = selectField(start, end, job->source->outputField, job->source->outputSeparator, &end);
+  while (end > start && end[-1] == '\n') end--; /* Trailing newlines go, the same as with $(...). */
+
+  size_t length = end - start;
+  memmove(captured->str, start, length);
+  captured->str[length] = '\0';
+  return g_string_free(captured, false);
+}
+
+static void streamsDone(Job *job) {
+  /* Flushing waits for both streams, so a trailing partial line from one isn't cut off by the other ending. */
+  if (job->output != -1 || job->errors != -1) return;
+  if (panelClosed(job->panel) || job->cancelled) return;
+  if (job->captured != NULL) {
+    usePanel(job->panel);
+    takeVariable(job->source->output, takeOutput(job));
+  }
+  if (job->reader != NULL) job->reader->finish(job->reader->data);
+  if (job->progress != NULL) progressFlush(job->progress);
+  if (job->console != NULL) consoleFlush(job->console);
+  if (job->errorConsole != NULL && job->errorConsole != job->console) consoleFlush(job->errorConsole);
+}
+
+/* Both pipes are watched by the same main loop, so they are polled together and read in the order
+   their output arrives. Neither can fill up and stall the child while we wait on the other. */
+static gboolean readOutput(gint fd, GIOCondition condition, gpointer data) {
+  Job *job = data;
+  if (readStream(job, fd, false)) return G_SOURCE_CONTINUE;
+
+  job->output = -1;
+  streamsDone(job);
+  finishJob(job);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean readErrors(gint fd, GIOCondition condition, gpointer data) {
+  Job *job = data;
+  if (readStream(job, fd, true)) return G_SOURCE_CONTINUE;
+
+  job->errors = -1;
+  streamsDone(job);
+  finishJob(job);
+  return G_SOURCE_REMOVE;
+}
+
+static void closePipe(int ends[2]) {
+  if (ends[0] != -1) close(ends[0]);
+  if (ends[1] != -1) close(ends[1]);
+}
+
+static char *describeExit(Command *command, int status, struct rusage *usage, const char *reason) {
+  /* Says how a command ended when it was killed or ran under limits. Exiting normally without limits isn't news. */
+  bool limited = command->timeout > 0 || command->maxMemory > 0 || command->maxCpu > 0;
+  if (reason == NULL && !limited && !WIFSIGNALED(status)) return NULL;
+  if (reason == NULL && WIFSIGNALED(status) && WTERMSIG(status) == SIGXCPU) reason = "ran out of processor time";
+
+  GString *report = g_string_new("[");
+  if (reason != NULL) g_string_append_printf(report, "%s, ", reason);
+  if (WIFSIGNALED(status)) {
+    g_string_append_printf(report, "killed by signal %d (%s)", WTERMSIG(status), strsignal(WTERMSIG(status)));
+  } else {
+    g_string_append_printf(report, "exited with status %d", WEXITSTATUS(status));
+  }
+  if (usage != NULL) {
+    g_string_append_printf(report, ", %ld.%02lds user, %ld.%02lds system, %ld MB peak memory",
+                           (long) usage->ru_utime.tv_sec, (long) usage->ru_utime.tv_usec / 10000,
+                           (long) usage->ru_stime.tv_sec, (long) usage->ru_stime.tv_usec / 10000,
+                           usage->ru_maxrss / 1024);
+  }
+  g_string_append(report, "]\n");
+  return g_string_free(report, false);
+}
+
+static void jobExited(Job *job, int status, struct rusage *usage) {
+  job->report = describeExit(job->source, status, usage, job->reason);
+  job->status = status;
+  job->pid = 0;
+  children--;
+  finishJob(job);
+  dispatchJobs();
+}
+
+static gboolean reapJob(gint fd, GIOCondition condition, gpointer data) {
+  /* The pidfd turns readable once the child exits, and wait4 hands back its resource usage along with its status. */
+  Job *job = data;
+  int status;
+  struct rusage usage;
+  pid_t result = wait4(job->pid, &status, WNOHANG, &usage);
+  if (result == 0 || (result == -1 && errno == EINTR)) return G_SOURCE_CONTINUE;
+
+  close(fd);
+  if (result == -1) status = 0; /* Reaped elsewhere, there's no status left to report. */
+  jobExited(job, status, result == -1 ? NULL : &usage);
+  return G_SOURCE_REMOVE;
+}
+
+static void childExited(GPid pid, gint status, gpointer data) {
+  /* For kernels without pidfds. GLib reaps the child itself, so there's no resource usage. */
+  g_spawn_close_pid(pid);
+  jobExited(data, status, NULL);
+}
+
+static void spawnedExited(void *data, int status, struct rusage *usage) {
+  jobExited(data, status, usage);
+}
+
+static void watchChild(Job *job, bool helped) {
+  /* The spawn helper is the parent of what it starts, so only it can wait for them. It tells us when they exit. */
+  if (helped) {
+    watchSpawned(job->pid, spawnedExited, job);
+    return;
+  }
+  int fd = -1;
+#ifdef SYS_pidfd_open
+  fd = syscall(SYS_pidfd_open, job->pid, 0);
+#endif
+  if (fd == -1) {
+    g_child_watch_add(job->pid, childExited, job);
+    return;
+  }
+  g_unix_fd_add(fd, G_IO_IN, reapJob, job);
+}
+
+static char *inputFor(Command *command, size_t *length) {
+  /* Copied up front, since a textbox replaces its variable's value whenever it is edited. */
+  char *value = getVariable(command->input);
+  if (value == NULL) value = "";
+  *length = strlen(value);
+  return strdup(value);
+}
+
+static void watchStream(int fd, GUnixFDSourceFunc function, Job *job) {
+  /* Reading at idle priority keeps redraws and input flowing while a chatty command runs. */
+  g_unix_fd_add_full(G_PRIORITY_DEFAULT_IDLE, fd, G_IO_IN | G_IO_HUP | G_IO_ERR, function, job, NULL);
+}
+
+bool startJob(Command *command, JobWatcher *watcher) {
+  usePanel(command->panel);
+  char *expanded = parseCommand(command->command);
+  Reader *reader = command->reader;
+  /* Output that goes to a variable is only shown as well when a console is named. */
+  bool hidden = reader != NULL || (command->output != NULL && command->console == NULL);
+  Console *console = hidden ? NULL : findConsole(command->console);
+  Console *errorConsole = command->errors == NULL ? console : findConsole(command->errors);
+
+  if (!hidden && command->console != NULL && console == NULL) {
+    fprintf(stderr, "No console named '%s'!\n", command->console);
+    return false;
+  }
+  if (command->errors != NULL && errorConsole == NULL) {
+    fprintf(stderr, "No console named '%s'!\n", command->errors);
+    return false;
+  }
+  Progress *progress = command->progress == NULL ? NULL : findProgress(command->progress);
+  if (command->progress != NULL && progress == NULL) {
+    fprintf(stderr, "No progress bar named '%s'!\n", command->progress);
+    return false;
+  }
+
+  int output[2] = {-1, -1};
+  int errors[2] = {-1, -1};
+  int input[2] = {-1, -1};
+
+  /* Without a console the child simply inherits our stdout and stderr, and without input our stdin. */
+  bool capture = console != NULL || reader != NULL || progress != NULL || command->output != NULL;
+  if ((capture && pipe2(output, O_CLOEXEC)) ||
+      (errorConsole != NULL && pipe2(errors, O_CLOEXEC)) ||
+      (command->input != NULL && pipe2(input, O_CLOEXEC))) {
+    fprintf(stderr, "Pipe failed!\n");
+    closePipe(output);
+    closePipe(errors);
+    closePipe(input);
+    return false;
+  }
+
+  char **environment = variableEnvironment();
+  int childFds[3] = { input[0], output[1], errors[1] }; /* -1 where the child keeps ours. */
+  bool forkHere;
+  pid_t pid = helperSpawn(expanded, environment, childFds, command->maxMemory, command->maxCpu, &forkHere);
+  bool helped = pid != -1;
+  if (!helped && forkHere) pid = fork();
+  if (pid == -1) {
+    if (forkHere) {
+      fprintf(stderr, "Failed to open shell process.\n");
+    } else {
+      fprintf(stderr, "Lost the spawn helper, '%s' may or may not have started.\n", expanded);
+    }
+    closePipe(output);
+    closePipe(errors);
+    closePipe(input);
+    return false;
+  } else if (pid == 0) {
+    becomeChild(expanded, environment, childFds, command->maxMemory, command->maxCpu);
+  }
+
+  if (!helped) setpgid(pid, 0); /* Both sides set it, so it's in place before either one goes on. */
+
+  Job *job = allocate(sizeof(Job), "Ran out of memory starting job.");
+  job->panel = command->panel;
+  job->command = expanded;
+  job->console = console;
+  job->errorConsole = errorConsole;
+  job->reader = reader;
+  job->progress = progress;
+  job->source = command;
+  job->watcher = watcher;
+  job->captured = command->output == NULL ? NULL : g_string_new(NULL);
+  job->pid = pid;
+  job->group = pid;
+  job->cancelled = false;
+  job->timer = command->timeout > 0 ? g_timeout_add_seconds(command->timeout, timeoutJob, job) : 0;
+  job->reason = NULL;
+  job->status = 0;
+  job->report = NULL;
+  job->output = -1;
+  job->errors = -1;
+  job->input = -1;
+  job->inputChars = NULL;
+  job->inputLength = 0;
+  job->inputWritten = 0;
+  job->previous = NULL;
+  job->next = jobs;
+  if (jobs != NULL) jobs->previous = job;
+  jobs = job;
+  command->running++;
+  command->latest = job;
+  children++;
+  holdPanel(command->panel);
+  watchChild(job, helped);
+
+  if (command->input != NULL) {
+    close(input[0]);
+    job->input = input[1];
+    job->inputChars = inputFor(command, &job->inputLength);
+    fcntl(job->input, F_SETFL, fcntl(job->input, F_GETFL) | O_NONBLOCK);
+    g_unix_fd_add_full(G_PRIORITY_DEFAULT_IDLE, job->input, G_IO_OUT | G_IO_HUP | G_IO_ERR, writeJob, job, NULL);
+  }
+
+  if (capture) {
+    close(output[1]); /* Close the write end of the pipe. */
+    if (console != NULL) consoleClear(console);
+    if (progress != NULL) progressClear(progress);
+    job->output = output[0];
+    watchStream(job->output, readOutput, job);
+  }
+
+  if (errorConsole != NULL) {
+    close(errors[1]);
+    if (errorConsole != console) consoleClear(errorConsole);
+    job->errors = errors[0];
+    watchStream(job->errors, readErrors, job);
+  }
+  return true;
+}
+
+static volatile pid_t headlessGroup = 0; /* The headless child's process group while we wait on it, 0 otherwise. */
+static volatile sig_atomic_t overdue = 0; /* How many times the headless child's alarm has gone off. */
+
+static void alarmed(int number) {
+  /* Killing from the handler itself means there's no window where the alarm goes off and nobody acts on it.
+     The whole group goes, so the rest of a pipeline or a command list doesn't outlive the shell. */
+  if (overdue++ == 0) {
+    kill(-headlessGroup, SIGTERM);
+    alarm(JOB_KILL_GRACE);
+  } else {
+    kill(-headlessGroup, SIGKILL);
+  }
+}
+
+static void forwardSignal(int number) {
+  /* The child has a group of its own, so what's aimed at us is passed on. We go on waiting and exit with its status. */
+  if (headlessGroup != 0) kill(-headlessGroup, number);
+}
+
+static void takeTerminal(pid_t group) {
+  /* Called from the background, which would otherwise stop us with SIGTTOU. */
+  void (*previous)(int) = signal(SIGTTOU, SIG_IGN);
+  tcsetpgrp(0, group);
+  signal(SIGTTOU, previous);
+}
+
+int runHeadless(Command *command) {
+  /* Without a main loop the child simply shares our stdout and stderr, and we wait for it.
+     Returns the exit status the way a shell would report it. */
+  usePanel(command->panel);
+  char *expanded = parseCommand(command->command);
+
+  int input[2] = {-1, -1};
+  if (command->input != NULL && pipe2(input, O_CLOEXEC)) {
+    fprintf(stderr, "Pipe failed!\n");
+    return 126;
+  }
+
+  /* The child leads its own process group, like jobs in the window, so a timeout takes down everything it
+     started. When we have the terminal it gets handed over, so ^C and reading from it work as they did. */
+  bool foreground = isatty(0) && tcgetpgrp(0) == getpgrp();
+  void (*previousInt)(int) = signal(SIGINT, forwardSignal);
+  void (*previousTerm)(int) = signal(SIGTERM, forwardSignal);
+  void (*previousHup)(int) = signal(SIGHUP, forwardSignal);
+
+  char **environment = variableEnvironment();
+  pid_t pid = fork();
+  if (pid == -1) {
+    fprintf(stderr, "Failed to open shell process.\n");
+    signal(SIGINT, previousInt);
+    signal(SIGTERM, previousTerm);
+    signal(SIGHUP, previousHup);
+    closePipe(input);
+    return 126;
+  } else if (pid == 0) {
+    signal(SIGPIPE, SIG_DFL);
+    setpgid(0, 0);
+    if (foreground) takeTerminal(getpid());
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGHUP, SIG_DFL);
+    limitChild(command->maxMemory, command->maxCpu);
+    if (command->input != NULL) dup2(input[0], 0);
+    execShell(expanded, environment);
+  }
+
+  setpgid(pid, 0); /* Both sides set it, so it's in place before either one goes on. */
+  if (foreground) takeTerminal(pid);
+  headlessGroup = pid;
+  overdue = 0; /* A workflow runs one headless step after another. */
+  if (command->timeout > 0) {
+    signal(SIGALRM, alarmed);
+    alarm(command->timeout);
+  }
+
+  if (command->input != NULL) {
+    close(input[0]);
+    size_t length;
+    char *chars = inputFor(command, &length);
+    size_t written = 0;
+    while (written < length) {
+      ssize_t result = write(input[1], chars + written, length - written);
+      if (result == -1) {
+        if (errno == EINTR) continue;
+        break; /* EPIPE, the child isn't reading any more. */
+      }
+      written += result;
+    }
+    free(chars);
+    close(input[1]);
+  }
+
+  int status;
+  struct rusage usage;
+  pid_t waited;
+  while ((waited = wait4(pid, &status, 0, &usage)) == -1 && errno == EINTR);
+  alarm(0);
+  headlessGroup = 0;
+  if (foreground) takeTerminal(getpgrp());
+  signal(SIGINT, previousInt);
+  signal(SIGTERM, previousTerm);
+  signal(SIGHUP, previousHup);
+  if (waited == -1) return 126;
+
+  char *report = describeExit(command, status, &usage, overdue > 0 ? "timed out" : NULL);
+  if (report != NULL) {
+    fputs(report, stderr);
+    free(report);
+  }
+  if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+  return WEXITSTATUS(status);
+}
+
+void printJobStats(FILE *out) {
+  int count = 0;
+  for (Job *job = jobs; job != NULL; job = job->next) count++;
+  int pending = 0;
+  for (Pending *entry = firstPending; entry != NULL; entry = entry->next) pending++;
+  fprintf(out, "  jobs: %d running, %d queued, limit %d\n", count, pending, jobLimit);
+
+  for (Job *job = jobs; job != NULL; job = job->next) {
+    if (job->pid != 0) {
+      fprintf(out, "    pid %d", (int) job->pid);
+    } else {
+      fprintf(out, "    exited");
+    }
+    fprintf(out, ", %zu of %zu input bytes written, %s: %s\n", job->inputWritten, job->inputLength,
+            job->output != -1 || job->errors != -1 ? "reading" : "done reading", job->command);
+  }
+}
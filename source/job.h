@@ -0,0 +1,71 @@
+#ifndef SGIDLS_JOB
+#define SGIDLS_JOB
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "table.h"
+
+/* Takes a command's stdout in place of a console, for widgets that fill themselves in from a command. */
+typedef struct {
+  void (*write)(void *data, const char *chars, size_t length);
+  void (*finish)(void *data); /* Called once the output has ended. */
+  void *data;
+} Reader;
+
+/* Told whether a run succeeded, for commands started as one step of a workflow. */
+typedef struct {
+  void (*finish)(void *data, bool success);
+  void *data;
+} JobWatcher;
+
+typedef enum {
+  CONCURRENCY_PARALLEL, /* Every click starts another run, the default. */
+  CONCURRENCY_QUEUE, /* Clicks during a run start another one after it, one at a time. */
+  CONCURRENCY_DROP, /* Clicks during a run are ignored. */
+  CONCURRENCY_RESTART /* Clicks during a run kill it and start over. */
+} Concurrency;
+
+typedef struct Job Job;
+typedef struct Workflow Workflow;
+
+struct Command {
+  Panel *panel; /* The panel whose variables and consoles the command uses. */
+  char *command;
+  char *console; /* Name of the console that receives the output, NULL for the default console. */
+  char *errors; /* Name of the console that receives stderr, NULL for the same one as stdout. */
+  char *input; /* Variable whose value is fed to the command's stdin, NULL to inherit ours. */
+  Reader *reader; /* Receives stdout instead of a console when set. */
+  char *progress; /* Name of a progress bar that follows the output, NULL for none. */
+  char *output; /* Variable that receives stdout, NULL for none. */
+  int outputLine; /* Line of the output to keep, counting from 1, or 0 for all of it. */
+  int outputField; /* Field of that line to keep, counting from 1, or 0 for the whole line. */
+  char *outputSeparator; /* NULL splits fields on runs of whitespace. */
+  int timeout; /* Seconds before the command is killed, 0 for no limit. */
+  int maxMemory; /* Megabytes of address space the command may use, 0 for no limit. */
+  int maxCpu; /* Seconds of processor time the command may use, 0 for no limit. */
+  char **after; /* Names of the buttons whose commands have to succeed first, NULL for none. */
+  int afterCount;
+
+  Concurrency concurrency;
+  int running; /* Runs started and not yet finished. */
+  int queued; /* Runs waiting for the job limit. */
+  int waiting; /* Runs held back by the queue policy until the current one finishes. */
+  Job *latest; /* The most recent run still going, NULL when there is none. */
+  Workflow *latestWorkflow; /* Likewise for a button with prerequisites, whose runs are workflows. */
+  Command *next; /* Every command of a panel that hasn't been freed. */
+};
+
+extern Command *newCommand(char *command);
+extern bool startJob(Command *command, JobWatcher *watcher);
+extern bool requestJob(Command *command);
+extern bool runStep(Command *command, JobWatcher *watcher);
+extern void cancelStep(JobWatcher *watcher);
+extern void workflowEnded(Command *command);
+extern void setJobLimit(int limit);
+extern int runHeadless(Command *command);
+extern void freePanelCommands(Panel *panel);
+extern void printJobStats(FILE *out);
+
+#endif
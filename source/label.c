@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <gtk/gtk.h>
+
+#include "common.h"
+#include "label.h"
+#include "table.h"
+
+static Label *labels = NULL;
+static Label *dirtyLabels = NULL;
+static guint renderSource = 0; /* Pending idle render, 0 when there is none. */
+static GString *expansion = NULL; /* Reused for every render. */
+
+static void expandLabel(Label *label) {
+  /* Variables that are disabled or not declared expand to nothing, as they do in commands. */
+  g_string_truncate(expansion, 0);
+  const char *chars = label->format;
+  while (*chars != '\0') {
+    const char *open = strchr(chars, '%');
+    const char *close = open == NULL ? NULL : strchr(open + 1, '%');
+    if (close == NULL) {
+      g_string_append(expansion, chars);
+      break;
+    }
+
+    g_string_append_len(expansion, chars, open - chars);
+    char *name = g_strndup(open + 1, close - open - 1);
+    char *value = getVariable(name);
+    if (value != NULL) g_string_append(expansion, value);
+    g_free(name);
+    chars = close + 1;
+  }
+}
+
+static gboolean renderLabels(gpointer data) {
+  /* However many changes came in since the last render, each label is redrawn once. */
+  while (dirtyLabels != NULL) {
+    Label *label = dirtyLabels;
+    dirtyLabels = label->nextDirty;
+    label->dirty = false;
+    label->nextDirty = NULL;
+    if (panelClosed(label->panel)) continue;
+
+    usePanel(label->panel);
+    expandLabel(label);
+    gtk_label_set_text(GTK_LABEL(label->widget), expansion->str);
+  }
+
+  renderSource = 0;
+  return G_SOURCE_REMOVE;
+}
+
+static void labelChanged(void *data) {
+  Label *label = data;
+  if (label->dirty) return;
+
+  label->dirty = true;
+  label->nextDirty = dirtyLabels;
+  dirtyLabels = label;
+  if (renderSource == 0) renderSource = g_idle_add(renderLabels, NULL);
+}
+
+GtkWidget *newLabel(char *text) {
+  /* Text without variables stays a plain label with nothing watching it. */
+  if (strchr(text, '%') == NULL) return gtk_label_new(text);
+
+  Label *label = allocate(sizeof(Label), "Ran out of memory creating label.");
+  label->widget = gtk_label_new(NULL);
+  label->format = text;
+  label->panel = getPanel();
+  label->dirty = false;
+  label->nextDirty = NULL;
+  label->next = labels;
+  labels = label;
+  if (expansion == NULL) expansion = g_string_new(NULL);
+
+  const char *chars = text;
+  while (true) {
+    const char *open = strchr(chars, '%');
+    const char *close = open == NULL ? NULL : strchr(open + 1, '%');
+    if (close == NULL) break;
+
+    /* The watch table keeps the key, so each name gets its own copy for the life of the panel. */
+    watchVariable(g_strndup(open + 1, close - open - 1), labelChanged, label);
+    chars = close + 1;
+  }
+
+  labelChanged(label); /* Variables declared later in the file show up in the first render. */
+  return label->widget;
+}
+
+void freePanelLabels(Panel *panel) {
+  /* The watches that point at the labels went when the panel closed, only the dirty list may still hold them. */
+  Label **link = &dirtyLabels;
+  while (*link != NULL) {
+    if ((*link)->panel == panel) *link = (*link)->nextDirty;
+    else link = &(*link)->nextDirty;
+  }
+  link = &labels;
+  while (*link != NULL) {
+    Label *label = *link;
+    if (label->panel == panel) {
+      *link = label->next;
+      free(label);
+    } else {
+      link = &label->next;
+    }
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef SGIDLS_LABEL
+#define SGIDLS_LABEL
+
+#include <stdbool.h>
+#include <gtk/gtk.h>
+
+#include "table.h"
+
+/* A label whose text refers to variables with %name%, and follows them as they change. */
+typedef struct Label Label;
+
+struct Label {
+  GtkWidget *widget;
+  char *format;
+  Panel *panel;
+  bool dirty;
+  Label *nextDirty;
+  Label *next; /* Every label of a panel that hasn't been freed. */
+};
+
+extern GtkWidget *newLabel(char *text);
+extern void freePanelLabels(Panel *panel);
+
+#endif
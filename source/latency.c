@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib-unix.h>
+
+#include "config.h"
+#include "latency.h"
+
+#define SUBJECT_SIZE 64 /* Bytes of a button label or variable name kept, handlers can outlive their panel. */
+
+typedef struct {
+  const char *handler; /* Name of the function, always a string literal. */
+  char subject[SUBJECT_SIZE];
+  gint64 start; /* Monotonic microseconds. */
+} Frame;
+
+typedef struct {
+  const char *handler;
+  long calls;
+  gint64 total; /* Microseconds */
+  gint64 longest;
+} HandlerStats;
+
+typedef enum {
+  REPORT_SLOW, /* A handler ran past LATENCY_SLOW_HANDLER. */
+  REPORT_STALL /* The main loop missed its heartbeat for longer than the watchdog threshold. */
+} ReportKind;
+
+typedef struct {
+  ReportKind kind;
+  gint64 when; /* Wall clock microseconds, for matching up with other logs. */
+  gint64 duration;
+  bool ongoing; /* A stall the main loop hasn't come back from yet. */
+  const char *handler; /* NULL for a stall outside any handler, in reading command output say. */
+  char subject[SUBJECT_SIZE];
+} Report;
+
+/* All of this is shared with the watchdog thread, so it is only touched with the lock held. */
+static GMutex lock;
+static Frame frames[LATENCY_DEPTH];
+static int depth = 0; /* Can run past LATENCY_DEPTH, the frames that don't fit aren't timed. */
+static HandlerStats handlers[LATENCY_HANDLERS];
+static int handlerCount = 0;
+static Report reports[LATENCY_RING_SIZE];
+static size_t nextReport = 0; /* Oldest report once the ring is full. */
+static size_t reportCount = 0;
+
+static int stallThreshold = 0; /* Milliseconds, 0 while there is no watchdog. */
+static gint64 lastBeat = 0;
+static Report *stall = NULL; /* The stall in progress, NULL when the loop is keeping up. */
+
+static Report *addReport(ReportKind kind, gint64 duration, const Frame *frame) {
+  Report *report = &reports[nextReport];
+  if (report == stall) stall = NULL; /* Handlers nested in the stalled one filled the ring, it ends unmeasured. */
+  nextReport = (nextReport + 1) % LATENCY_RING_SIZE;
+  if (reportCount < LATENCY_RING_SIZE) reportCount++;
+
+  report->kind = kind;
+  report->when = g_get_real_time();
+  report->duration = duration;
+  report->ongoing = false;
+  report->handler = frame == NULL ? NULL : frame->handler;
+  if (frame == NULL) {
+    report->subject[0] = '\0';
+  } else {
+    memcpy(report->subject, frame->subject, SUBJECT_SIZE);
+  }
+  return report;
+}
+
+static void countCall(const char *handler, gint64 duration) {
+  HandlerStats *stats = NULL;
+  for (int i = 0; i < handlerCount; i++) {
+    if (handlers[i].handler == handler) {
+      stats = &handlers[i];
+      break;
+    }
+  }
+  if (stats == NULL) {
+    if (handlerCount == LATENCY_HANDLERS) return;
+    stats = &handlers[handlerCount++];
+    stats->handler = handler;
+    stats->calls = 0;
+    stats->total = 0;
+    stats->longest = 0;
+  }
+  stats->calls++;
+  stats->total += duration;
+  if (duration > stats->longest) stats->longest = duration;
+}
+
+void enterHandler(const char *handler, const char *subject) {
+  g_mutex_lock(&lock);
+  if (depth < LATENCY_DEPTH) {
+    Frame *frame = &frames[depth];
+    frame->handler = handler;
+    g_strlcpy(frame->subject, subject == NULL ? "" : subject, SUBJECT_SIZE);
+    frame->start = g_get_monotonic_time();
+  }
+  depth++;
+  g_mutex_unlock(&lock);
+}
+
+void leaveHandler() {
+  g_mutex_lock(&lock);
+  depth--;
+  if (depth < LATENCY_DEPTH) {
+    Frame *frame = &frames[depth];
+    gint64 duration = g_get_monotonic_time() - frame->start;
+    countCall(frame->handler, duration);
+    if (duration >= LATENCY_SLOW_HANDLER * 1000) addReport(REPORT_SLOW, duration, frame);
+  }
+  g_mutex_unlock(&lock);
+}
+
+const char *buttonSubject(GtkWidget *widget, const char *fallback) {
+  /* Buttons with a plain label are named by it, the rest by whatever the handler knows them by. */
+  const char *label = GTK_IS_BUTTON(widget) ? gtk_button_get_label(GTK_BUTTON(widget)) : NULL;
+  return label != NULL ? label : fallback;
+}
+
+/* Watchdog */
+
+static gboolean heartbeat(gpointer data) {
+  g_mutex_lock(&lock);
+  gint64 now = g_get_monotonic_time();
+  if (stall != NULL) {
+    stall->duration = now - lastBeat;
+    stall->ongoing = false;
+    stall = NULL;
+  }
+  lastBeat = now;
+  g_mutex_unlock(&lock);
+  return G_SOURCE_CONTINUE;
+}
+
+static gpointer watchdog(gpointer data) {
+  /* Only notices the stall. The heartbeat that ends it fills in how long it was. */
+  for (;;) {
+    g_usleep(LATENCY_HEARTBEAT * 1000);
+    g_mutex_lock(&lock);
+    gint64 late = g_get_monotonic_time() - lastBeat;
+    if (stall == NULL && late >= stallThreshold * 1000) {
+      /* The innermost handler is the one doing the work, the stall is its fault rather than the caller's. */
+      int top = depth < LATENCY_DEPTH ? depth : LATENCY_DEPTH;
+      stall = addReport(REPORT_STALL, late, top > 0 ? &frames[top - 1] : NULL);
+      stall->ongoing = true;
+    } else if (stall != NULL) {
+      stall->duration = late;
+    }
+    g_mutex_unlock(&lock);
+  }
+  return NULL;
+}
+
+void watchStalls(int threshold) {
+  stallThreshold = threshold;
+  lastBeat = g_get_monotonic_time();
+  g_timeout_add(LATENCY_HEARTBEAT, heartbeat, NULL);
+  g_thread_unref(g_thread_new("watchdog", watchdog, NULL));
+}
+
+/* Reports */
+
+static void printReport(FILE *out, const Report *report) {
+  time_t seconds = report->when / G_USEC_PER_SEC;
+  struct tm local;
+  localtime_r(&seconds, &local);
+  char clock[16];
+  strftime(clock, sizeof(clock), "%H:%M:%S", &local);
+
+  fprintf(out, "  %s.%03d  %-5s %8.1f ms%s", clock, (int) (report->when % G_USEC_PER_SEC / 1000),
+	  report->kind == REPORT_STALL ? "stall" : "slow", report->duration / 1000.0, report->ongoing ? " and counting" : "");
+  if (report->handler == NULL) {
+    fprintf(out, " outside any handler\n");
+  } else if (report->subject[0] == '\0') {
+    fprintf(out, " in %s\n", report->handler);
+  } else {
+    fprintf(out, " in %s for '%s'\n", report->handler, report->subject);
+  }
+}
+
+void printLatencyStats(FILE *out) {
+  g_mutex_lock(&lock);
+  fprintf(out, "Latency statistics for process %d\n", (int) getpid());
+  if (stallThreshold > 0) {
+    fprintf(out, "  watchdog: stalls over %d ms\n", stallThreshold);
+  } else {
+    fprintf(out, "  watchdog: off\n");
+  }
+  for (int i = 0; i < handlerCount; i++) {
+    HandlerStats *stats = &handlers[i];
+    fprintf(out, "  %-22s %8ld calls, %10.1f ms total, %8.1f ms longest\n", stats->handler, stats->calls,
+	    stats->total / 1000.0, stats->longest / 1000.0);
+  }
+
+  fprintf(out, "  %zu slow handlers and stalls, oldest first:\n", reportCount);
+  size_t first = (nextReport + LATENCY_RING_SIZE - reportCount) % LATENCY_RING_SIZE;
+  for (size_t i = 0; i < reportCount; i++) printReport(out, &reports[(first + i) % LATENCY_RING_SIZE]);
+  g_mutex_unlock(&lock);
+  fflush(out);
+}
+
+static gboolean latencyStatsRequested(gpointer data) {
+  printLatencyStats(stderr);
+  return G_SOURCE_CONTINUE;
+}
+
+void watchLatencyStats() {
+  /* Like the memory report this waits for the main loop, so during a stall it comes out once the stall is over. */
+  g_unix_signal_add(SIGUSR1, latencyStatsRequested, NULL);
+}
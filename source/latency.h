@@ -0,0 +1,21 @@
+#ifndef SGIDLS_LATENCY
+#define SGIDLS_LATENCY
+
+#include <stdio.h>
+#include <gtk/gtk.h>
+
+/* Every signal handler this program installs on its windows and widgets brackets its work with these, so a
+   handler that takes too long can be named along with the button or variable it was run for. Handlers that
+   run inside another one nest. Opening a panel is timed the same way. */
+extern void enterHandler(const char *handler, const char *subject);
+extern void leaveHandler();
+extern const char *buttonSubject(GtkWidget *widget, const char *fallback);
+
+/* Checks from another thread that the main loop is still getting around, and records the handler that was
+   running when it wasn't. Off unless started, the check costs a wakeup every LATENCY_HEARTBEAT milliseconds. */
+extern void watchStalls(int threshold);
+
+extern void printLatencyStats(FILE *out);
+extern void watchLatencyStats();
+
+#endif
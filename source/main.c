@@ -4,14 +4,21 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <signal.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "common.h"
 #include "config.h"
+#include "job.h"
+#include "latency.h"
 #include "parser.h"
+#include "spawn.h"
+#include "stats.h"
 #include "strings.h"
 #include "table.h"
-
-GtkTextBuffer *shell_buffer = NULL;
+#include "workflow.h"
 
 static char *readFile(FILE *file) {
   fseek(file, 0L, SEEK_END);
@@ -33,132 +40,310 @@ static char *readFile(FILE *file) {
 }
 
 void runCommand(GtkWidget *widget, gpointer data) {
-  char *command = parseCommand(data);
-
-  int mypipe[2];
-
-  if (pipe(mypipe)) {
-    fprintf(stderr, "Pipe failed!\n");
-    return;
-  }
-  
-  pid_t pid = fork();
-  if (pid == -1) {
-    fprintf(stderr, "Failed to open shell process.");
-  } else if (pid == 0) {
-    close(mypipe[0]); /* Close the read end of the pipe. */
-    dup2(mypipe[1], 1);
-    execl("/bin/sh", "sh", "-c", command, (char *) NULL);
-  } else {
-    close(mypipe[1]); /* Close the write end of the pipe. */
-    FILE *input = fdopen(mypipe[0], "r");
-
-    char *line = NULL;
-    size_t n = 0;
-    GtkTextIter iter;
-    gtk_text_buffer_set_text(shell_buffer, "", -1);
-    while ((getline(&line, &n, input)) != -1) {    
-    gtk_text_buffer_get_end_iter(shell_buffer, &iter);
-    gtk_text_buffer_insert(shell_buffer, &iter, line, -1);
-    }
-    free(line);
-  }
+  Command *command = data;
+  enterHandler("runCommand", buttonSubject(widget, command->command));
+  requestJob(command);
+  leaveHandler();
 }
 
-void toggleCommand(GtkWidget *widget, gpointer key) {
+void toggleCommand(GtkWidget *widget, gpointer data) {
+  Binding *binding = data;
+  enterHandler("toggleCommand", buttonSubject(widget, binding->key));
+  usePanel(binding->panel);
   bool active = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
-  bool success = enableVariable(key, active);
+  bool success = enableVariable(binding->key, active);
   if (!success) {
-    fprintf(stderr, "Error toggling variable '%s'! Maybe it wasn't declared?", (char *)key);
+    fprintf(stderr, "Error toggling variable '%s'! Maybe it wasn't declared?", binding->key);
   }
+  leaveHandler();
 }
 
-void toggleWidget(GtkWidget *widget, gpointer name) {
+void toggleWidget(GtkWidget *widget, gpointer data) {
+  Binding *binding = data;
+  enterHandler("toggleWidget", buttonSubject(widget, binding->key));
+  usePanel(binding->panel);
   bool active = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
-  bool success = setSensitiveWidget(name, active);
+  bool success = setSensitiveWidget(binding->key, active);
   if (!success) {
-    fprintf(stderr, "Error toggling widget '%s'! Maybe it wasn't named?", (char *)name);
+    fprintf(stderr, "Error toggling widget '%s'! Maybe it wasn't named?", binding->key);
   }
+  leaveHandler();
 }
 
-void updateVariable(GtkEntryBuffer *text, guint position, gchar *chars, guint n_chars,  gpointer key) {
-  const char *buffer = gtk_entry_buffer_get_text(text);
-  bool success = setVariable(key, buffer);
+void updateVariable(GtkEditable *editable, gpointer data) {
+  Binding *binding = data;
+  enterHandler("updateVariable", binding->key);
+  usePanel(binding->panel);
+  const char *buffer = gtk_entry_get_text(GTK_ENTRY(editable));
+  bool success = setVariable(binding->key, buffer);
   /* if (!success) {
     fprintf(stderr, "Error updating variable '%s' from text buffer!", (char *)key);
     } */
+  leaveHandler();
 }
 
-void updateConsoleVariable(GObject *text, GParamSpec *pspec, gpointer key) {
-  static int check_line = -1; /* Static variable to check if the cursor actually moved a line */
-  GtkTextMark *insert = gtk_text_buffer_get_insert(shell_buffer);
+void updateConsoleVariable(GObject *text, GParamSpec *pspec, gpointer data) {
+  Binding *binding = data;
+  enterHandler("updateConsoleVariable", binding->key);
+  usePanel(binding->panel);
+  GtkTextBuffer *buffer = GTK_TEXT_BUFFER(text);
+  GtkTextMark *insert = gtk_text_buffer_get_insert(buffer);
   GtkTextIter insert_iter;
-  gtk_text_buffer_get_iter_at_mark(shell_buffer, &insert_iter, insert);
+  gtk_text_buffer_get_iter_at_mark(buffer, &insert_iter, insert);
   int insert_line = gtk_text_iter_get_line(&insert_iter);
-  if (insert_line == check_line) {
+  if (insert_line == binding->line) { /* Only moving to another line changes the variable. */
+    leaveHandler();
     return;
-  } else {
-    check_line = insert_line;
   }
+  binding->line = insert_line;
 
   GtkTextIter line_start;
-  gtk_text_buffer_get_iter_at_line(shell_buffer, &line_start, insert_line);
+  gtk_text_buffer_get_iter_at_line(buffer, &line_start, insert_line);
   GtkTextIter line_end = line_start;
   gtk_text_iter_forward_to_line_end(&line_end);
 
-  static char *prev_chars = NULL;
-  if (prev_chars != NULL) {
-    free(prev_chars);
+  /* The variable keeps the line, and frees it once the cursor moves on. */
+  takeVariable(binding->key, gtk_text_buffer_get_slice(buffer, &line_start, &line_end, false));
+  leaveHandler();
+}
+
+void updateTableVariable(GtkTreeSelection *selection, gpointer data) {
+  Binding *binding = data;
+  enterHandler("updateTableVariable", binding->key);
+  usePanel(binding->panel);
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  if (!gtk_tree_selection_get_selected(selection, &model, &iter)) {
+    leaveHandler();
+    return;
   }
-  char *new_chars = gtk_text_buffer_get_slice(shell_buffer, &line_start, &line_end, false);
-  prev_chars = new_chars;
-  setVariable(key, new_chars);
+
+  char *line = NULL;
+  gtk_tree_model_get(model, &iter, 0, &line, -1); /* Column 0 holds the whole line. */
+  takeVariable(binding->key, line);
+  leaveHandler();
 }
 
-static void activate(GtkApplication *app, gpointer userdata) {
+static bool resident = false;
+static char *firstFile = NULL;
+
+static void panelDestroyed(GtkWidget *window, gpointer data) {
+  enterHandler("panelDestroyed", gtk_window_get_title(GTK_WINDOW(window)));
+  closePanel(data);
+  leaveHandler();
+}
+
+typedef struct {
+  char *source; /* The whole file, or NULL when it is read as it arrives. */
+  int input; /* What to read it from in that case, -1 otherwise. */
+} Description;
+
+static void openPanel(GtkApplication *app, Description *description, const char *path) {
   GtkWidget *window;
-  GtkWidget *list;
+  enterHandler("openPanel", path);
   
   window = gtk_application_window_new(app);
   gtk_window_set_title(GTK_WINDOW(window), "Window");
   gtk_window_set_default_size(GTK_WINDOW(window), 200, 200);
-  
-  build(userdata, window);
+
+  Panel *panel = newPanel();
+  usePanel(panel);
+  g_signal_connect(window, "destroy", G_CALLBACK(panelDestroyed), panel);
+
+  if (!build(description->source, description->input, path, window)) {
+    if (!resident) exit(1);
+    gtk_widget_destroy(window); /* A broken file shouldn't take down the panels that are already open. */
+    leaveHandler();
+    return;
+  }
 
   gtk_widget_show_all(window);
+  leaveHandler();
 }
 
-static char *openFile(char *filename) {
-  FILE *file = fopen(filename, "rb");
+static void activate(GtkApplication *app, gpointer userdata) {
+  openPanel(app, userdata, firstFile);
+}
 
-  if (file == NULL) {
+static bool openDescription(const char *filename, Description *description) {
+  /* Regular files are read in one go. Pipes, and '-' for stdin, can't be measured up front,
+     so they are parsed as they arrive instead. */
+  description->source = NULL;
+  description->input = -1;
+  int fd = strcmp(filename, "-") == 0 ? 0 : open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
     fprintf(stderr, "'%s' file could not be opened.\n", filename);
-    exit(EX_IOERR);
+    return false;
+  }
+
+  struct stat status;
+  if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode)) {
+    description->source = readFile(fdopen(fd, "rb"));
+  } else {
+    description->input = fd;
   }
-  return readFile(file);
+  return true;
+}
+
+static void closeDescription(Description *description) {
+  free(description->source);
+  if (description->input > 0) close(description->input); /* Leave stdin be. */
+}
+
+static void openFiles(GApplication *app, GFile **files, gint count, gchar *hint, gpointer userdata) {
+  /* Runs in the resident instance, whichever process the files were passed to. */
+  for (gint i = 0; i < count; i++) {
+    char *path = g_file_get_path(files[i]);
+    Description description;
+    if (path != NULL && openDescription(path, &description)) {
+      openPanel(GTK_APPLICATION(app), &description, path);
+      closeDescription(&description);
+    }
+    g_free(path);
+  }
+}
+
+static void startResident(GApplication *app, gpointer userdata) {
+  /* Keep running with no windows open, waiting for the next file. */
+  g_application_hold(app);
+}
+
+static int runHeadlessFile(char *path, char *action, char **settings, int settingCount) {
+  /* No GTK at all here, so this works without a display. */
+  Description description;
+  if (!openDescription(path, &description)) return EX_IOERR;
+  if (!buildHeadless(description.source, description.input, path)) return EX_DATAERR;
+
+  for (int i = 0; i < settingCount; i += 2) {
+    char *option = settings[i];
+    char *value = settings[i + 1];
+    if (strcmp(option, "--set") == 0) {
+      char *equals = strchr(value, '=');
+      if (equals == NULL) {
+        fprintf(stderr, "'--set %s' should be '--set name=value'!\n", value);
+        return EX_USAGE;
+      }
+      *equals = '\0';
+      setVariable(value, equals + 1);
+    } else if (!enableVariable(value, strcmp(option, "--enable") == 0)) {
+      fprintf(stderr, "No variable named '%s'!\n", value);
+      return EX_USAGE;
+    }
+  }
+
+  Command *command = getAction(action);
+  if (command == NULL) {
+    fprintf(stderr, "No button named '%s' runs a command!\n", action);
+    return EX_USAGE;
+  }
+  int status = command->afterCount > 0 ? runHeadlessWorkflow(command) : runHeadless(command);
+
+  freeStrings();
+  closeDescription(&description);
+  return status;
 }
 
 int main(int argc, char **argv) {
+  char *program = argv[0];
   argc--, argv++;
 
-  if (argc != 1) {
+  bool memoryStats = false;
+  bool latencyStats = false;
+  int stallThreshold = 0;
+  bool spawnHelper = false;
+  char *action = NULL;
+  char **settings = allocate(sizeof(char *) * (argc + 1), "Ran out of memory reading options."); /* Option and value pairs, in order. */
+  int settingCount = 0;
+  while (argc > 1 && strncmp(argv[0], "--", 2) == 0) {
+    if (strcmp(argv[0], "--resident") == 0) {
+      resident = true;
+    } else if (strcmp(argv[0], "--mem-stats") == 0) {
+      memoryStats = true;
+    } else if (strcmp(argv[0], "--spawn-helper") == 0) {
+      spawnHelper = true;
+    } else if (strcmp(argv[0], "--latency-stats") == 0) {
+      latencyStats = true;
+    } else if (strcmp(argv[0], "--watchdog") == 0 && argc > 2) {
+      stallThreshold = (int) strtol(argv[1], NULL, 10);
+      if (stallThreshold < 1) {
+	fprintf(stderr, "The watchdog needs a threshold of at least one millisecond!\n");
+	exit(EX_USAGE);
+      }
+      argc--, argv++;
+    } else if (strcmp(argv[0], "--max-jobs") == 0 && argc > 2) {
+      int limit = (int) strtol(argv[1], NULL, 10);
+      if (limit < 1) {
+	fprintf(stderr, "At least one job has to be able to run!\n");
+	exit(EX_USAGE);
+      }
+      setJobLimit(limit);
+      argc--, argv++;
+    } else if (strcmp(argv[0], "--run") == 0 && argc > 2) {
+      action = argv[1];
+      argc--, argv++;
+    } else if ((strcmp(argv[0], "--set") == 0 || strcmp(argv[0], "--enable") == 0 || strcmp(argv[0], "--disable") == 0) && argc > 2) {
+      settings[settingCount++] = argv[0];
+      settings[settingCount++] = argv[1];
+      argc--, argv++;
+    } else {
+      fprintf(stderr, "Unknown option '%s'!\n", argv[0]);
+      exit(EX_USAGE);
+    }
+    argc--, argv++;
+  }
+
+  if (argc != 1 || (settingCount > 0 && action == NULL) || (action != NULL && resident)) {
     fprintf(stderr, "Bad usage!");
     exit(EX_USAGE);
   }
+  if (resident && strcmp(argv[0], "-") == 0) {
+    fprintf(stderr, "The resident instance can't read a description from stdin, only from files.\n");
+    exit(EX_USAGE);
+  }
 
-  char *source = openFile(argv[0]);
+  signal(SIGPIPE, SIG_IGN); /* A command that stops reading its stdin shouldn't take us down with it. */
+  if (action != NULL) {
+    int status = runHeadlessFile(argv[0], action, settings, settingCount);
+    free(settings);
+    return status;
+  }
+  free(settings);
+  /* Before anything else, while the process is as small as it gets. Without it commands are forked from here. */
+  if (spawnHelper) startSpawnHelper();
+  watchMemoryStats(); /* kill -USR2 prints a report at any time. */
+  watchLatencyStats(); /* And kill -USR1 one of slow handlers and stalls. */
+  if (stallThreshold > 0) watchStalls(stallThreshold);
   
   GtkApplication *app;
   int status;
+  Description description = { NULL, -1 };
 
-  shell_buffer = gtk_text_buffer_new(NULL);
-  
-  app = gtk_application_new("com.sktb.sidli", G_APPLICATION_FLAGS_NONE);
-  g_signal_connect(app, "activate", G_CALLBACK(activate), source);
-  status = g_application_run(G_APPLICATION(app), argc, argv);
+  if (resident) {
+    /* The first instance stays up and opens every file handed to it. Later ones pass their file along
+       over D-Bus and exit, so a panel opens without paying for GTK startup again. */
+    char *arguments[] = { program, argv[0], NULL };
+    app = gtk_application_new("com.sktb.sidli", G_APPLICATION_HANDLES_OPEN);
+    g_signal_connect(app, "startup", G_CALLBACK(startResident), NULL);
+    g_signal_connect(app, "open", G_CALLBACK(openFiles), NULL);
+    /* Registering tells us whether another instance is already up. If so this one only hands its file over,
+       and never runs a command. */
+    if (g_application_register(G_APPLICATION(app), NULL, NULL) && g_application_get_is_remote(G_APPLICATION(app))) {
+      stopSpawnHelper();
+    }
+    status = g_application_run(G_APPLICATION(app), 2, arguments);
+  } else {
+    firstFile = argv[0];
+    if (!openDescription(firstFile, &description)) exit(EX_IOERR);
+
+    app = gtk_application_new("com.sktb.sidli", G_APPLICATION_NON_UNIQUE);
+    g_signal_connect(app, "activate", G_CALLBACK(activate), &description);
+    status = g_application_run(G_APPLICATION(app), 0, NULL);
+  }
   g_object_unref(app);
 
+  if (memoryStats) printMemoryStats(stderr);
+  if (latencyStats) printLatencyStats(stderr);
   freeStrings();
-  free(source);
+  closeDescription(&description);
   return status;
 }
@@ -6,6 +6,15 @@
 
 #include "common.h"
 #include "config.h"
+#include "checklist.h"
+#include "completion.h"
+#include "console.h"
+#include "fragment.h"
+#include "job.h"
+#include "label.h"
+#include "progress.h"
+#include "save.h"
+#include "search.h"
 #include "scanner.h"
 #include "parser.h"
 #include "strings.h"
@@ -16,6 +25,11 @@ typedef struct {
   Token previous;
   bool hadError;
   bool panicMode;
+
+  Fragment *fragment; /* Included file being read from, NULL while reading the main file. */
+  int position; /* Next token in the fragment. */
+  char *directory; /* Where the file being read lives, for resolving includes. */
+  bool headless; /* Only variables and buttons matter, no widgets are made. */
 } Parser;
 
 Token nulltoken = (Token) {TOKEN_NULL, NULL, 0, 0};
@@ -31,12 +45,19 @@ static void initParser() {
   parser.previous = nulltoken;
   parser.hadError = false;
   parser.panicMode = false;
+  parser.fragment = NULL;
+  parser.position = 0;
+  parser.headless = false;
 }
 
 static void errorAt(Token *token, char *message) {
   if (parser.panicMode) return;
 
-  fprintf(stderr, "[line %d] Error", token->line);
+  if (parser.fragment != NULL) {
+    fprintf(stderr, "[%s line %d] Error", parser.fragment->path, token->line);
+  } else {
+    fprintf(stderr, "[line %d] Error", token->line);
+  }
 
   if (token->type == TOKEN_EOF) {
     fprintf(stderr, " at end");
@@ -59,7 +80,12 @@ static void advance() {
   parser.previous = parser.current;
 
   while (true) {
-    parser.current = scanToken();
+    if (parser.fragment == NULL) {
+      parser.current = scanToken();
+    } else {
+      parser.current = parser.fragment->tokens[parser.position];
+      if (parser.position < parser.fragment->count - 1) parser.position++; /* Stay on the EOF at the end. */
+    }
     //printToken(&parser.current);
     if (parser.current.type != TOKEN_ERROR) return;
 
@@ -86,6 +112,22 @@ static void consume(tokenType type, char *message) {
   error(message);
 }
 
+static void skipValue() {
+  /* Steps over a whole value, however deeply nested, for widgets that don't exist without a display. */
+  int depth = 0;
+  do {
+    advance();
+    switch (parser.previous.type) {
+    case TOKEN_OPEN_OBJECT:
+    case TOKEN_OPEN_ARRAY: depth++; break;
+    case TOKEN_CLOSE_OBJECT:
+    case TOKEN_CLOSE_ARRAY: depth--; break;
+    case TOKEN_EOF: error("File ends in the middle of a value."); return;
+    default: break;
+    }
+  } while (depth > 0);
+}
+
 static void nameWidget(GtkWidget *parent) {
   consume(TOKEN_STRING, "Widget name must be a string!");
   char *name = pluckToken(&parser.previous);
@@ -95,9 +137,9 @@ static void nameWidget(GtkWidget *parent) {
 
 static void setSensitive(GtkWidget *parent) {
   if (match(TOKEN_TRUE)) {
-    gtk_widget_set_sensitive(parent, true);
+    if (!parser.headless) gtk_widget_set_sensitive(parent, true);
   } else if (match(TOKEN_FALSE)) {
-    gtk_widget_set_sensitive(parent, false);
+    if (!parser.headless) gtk_widget_set_sensitive(parent, false);
   }
 }
 
@@ -114,11 +156,15 @@ static void setExpand(GtkWidget *widget, gpointer box) {
 }
 
 static void label(GtkWidget *parent) {
+  if (parser.headless) {
+    skipValue();
+    return;
+  }
   GtkWidget *da_label;
   
   consume(TOKEN_STRING, "Invalid label text.");
   char *labeltext = pluckToken(&parser.previous);
-  da_label = gtk_label_new(labeltext);
+  da_label = newLabel(labeltext);
   gtk_container_add(GTK_CONTAINER(parent), da_label);
 }
 
@@ -126,6 +172,7 @@ static void line(GtkWidget *parent) {
   GtkWidget *da_line;
 
   advance(); /* It really doesn't matter what you put here, a line is a line */
+  if (parser.headless) return;
   da_line = gtk_separator_new(GTK_ORIENTATION_HORIZONTAL);
   gtk_container_add(GTK_CONTAINER(parent), da_line);
 }
@@ -133,6 +180,7 @@ static void line(GtkWidget *parent) {
 static void bar(GtkWidget *parent) {
   GtkWidget *da_bar;
   advance();
+  if (parser.headless) return;
   da_bar = gtk_separator_new(GTK_ORIENTATION_VERTICAL);
   gtk_container_add(GTK_CONTAINER(parent), da_bar);
 }
@@ -167,6 +215,10 @@ static void variable() {
 }
 
 static void textbox(GtkWidget *parent) {
+  if (parser.headless) {
+    skipValue();
+    return;
+  }
   consume(TOKEN_OPEN_OBJECT, "Missing opening curly brace for textbox description.");
 
   GtkWidget *textbox;
@@ -188,12 +240,18 @@ static void textbox(GtkWidget *parent) {
 
       hasVariable = true;
       char *variable = pluckToken(&parser.previous);
-      g_signal_connect(text, "inserted-text", G_CALLBACK(updateVariable), variable);
+      /* "changed" comes after deletions as well as insertions, so the environment and labels see every edit. */
+      g_signal_connect(textbox, "changed", G_CALLBACK(updateVariable), newBinding(variable));
     } break;
     case TOKEN_NAME: {
       consume(TOKEN_COLON, "Missing colon.");
       nameWidget(textbox);
     } break;
+    case TOKEN_COMPLETION: {
+      consume(TOKEN_COLON, "Missing colon.");
+      consume(TOKEN_STRING, "Completion must be a command string!");
+      newCompletion(textbox, newCommand(pluckToken(&parser.previous)));
+    } break;
     default: error("Invalid keyword for textbox description.");
     }
 
@@ -236,7 +294,7 @@ static void checkbox(GtkWidget *parent) {
       char *variable = pluckToken(&parser.previous);
       bool isEnabled = getEnableVariable(variable);
       gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(checkbox), isEnabled);
-      g_signal_connect(checkbox, "toggled", G_CALLBACK(toggleCommand), variable);
+      g_signal_connect(checkbox, "toggled", G_CALLBACK(toggleCommand), newBinding(variable));
     } break;
     case TOKEN_ENABLE: {
       hasConnection = true;
@@ -245,7 +303,7 @@ static void checkbox(GtkWidget *parent) {
       consume(TOKEN_STRING, "Invalid widget name.");
 
       char *widget = pluckToken(&parser.previous);
-      g_signal_connect(checkbox, "toggled", G_CALLBACK(toggleWidget), widget);
+      g_signal_connect(checkbox, "toggled", G_CALLBACK(toggleWidget), newBinding(widget));
     } break;
     default: error("Invalid checklist keyword.");
     }
@@ -256,7 +314,64 @@ static void checkbox(GtkWidget *parent) {
   if (!hasConnection) error("Check button with no connections!");
 }
 
+static void sourcedChecklist(GtkWidget *parent) {
+  consume(TOKEN_OPEN_OBJECT, "Missing opening curly brace for checklist description.");
+
+  char *source = NULL;
+  char *variable = NULL;
+  char *separator = NULL;
+  char *name = NULL;
+
+  while (!match(TOKEN_CLOSE_OBJECT)) {
+    advance();
+    switch (parser.previous.type) {
+    case TOKEN_SOURCE: {
+      consume(TOKEN_COLON, "Missing colon.");
+      consume(TOKEN_STRING, "Checklist source must be a command string!");
+      source = pluckToken(&parser.previous);
+    } break;
+    case TOKEN_VARIABLE: {
+      consume(TOKEN_COLON, "Missing colon.");
+      consume(TOKEN_STRING, "Invalid variable name.");
+      variable = pluckToken(&parser.previous);
+    } break;
+    case TOKEN_SEPARATOR: {
+      consume(TOKEN_COLON, "Missing colon.");
+      consume(TOKEN_STRING, "Separator must be a string!");
+      separator = unescapeString(pluckToken(&parser.previous));
+    } break;
+    case TOKEN_NAME: {
+      consume(TOKEN_COLON, "Missing colon.");
+      consume(TOKEN_STRING, "Widget name must be a string!");
+      name = pluckToken(&parser.previous);
+    } break;
+    default: error("Invalid checklist keyword.");
+    }
+
+    if (!check(TOKEN_CLOSE_OBJECT)) consume(TOKEN_COMMA, "Missing comma.");
+  }
+
+  if (source == NULL) error("No source set for checklist!");
+  if (variable == NULL) error("Checklist with no variable!");
+  if (parser.hadError) return;
+
+  Checklist *da_checklist = newChecklist(newCommand(source), variable, separator);
+  gtk_container_add(GTK_CONTAINER(parent), da_checklist->widget);
+  if (name != NULL && !setWidget(name, da_checklist->widget)) error("Something went wrong with widget naming!");
+
+  refreshChecklist(da_checklist);
+}
+
 static void checklist(GtkWidget *parent) {
+  if (parser.headless) {
+    skipValue();
+    return;
+  }
+  if (check(TOKEN_OPEN_OBJECT)) {
+    sourcedChecklist(parent);
+    return;
+  }
+
   consume(TOKEN_OPEN_ARRAY, "Missing opening square bracket for checklist description.");
 
   GtkWidget *list;
@@ -273,32 +388,198 @@ static void checklist(GtkWidget *parent) {
 }
 
 static void console(GtkWidget *parent) {
-  consume(TOKEN_OPEN_OBJECT, "Missing opening curly brace for console description!");
+  if (parser.headless) {
+    skipValue();
+    return;
+  }
+  ConsoleMode mode = CONSOLE_TEXT;
+  char *separator = NULL;
+  char *variable = NULL;
+  char *name = NULL;
+  bool hasSearch = false;
+
+  if (!match(TOKEN_NULL)) {
+    consume(TOKEN_OPEN_OBJECT, "Missing opening curly brace for console description!");
+
+    while (!match(TOKEN_CLOSE_OBJECT)) {
+      advance();
+      switch (parser.previous.type) {
+      case TOKEN_VARIABLE: {
+	consume(TOKEN_COLON, "Missing colon.");
+	consume(TOKEN_STRING, "Invalid variable name");
+	variable = pluckToken(&parser.previous);
+      } break;
+      case TOKEN_NAME: {
+	consume(TOKEN_COLON, "Missing colon.");
+	consume(TOKEN_STRING, "Console name must be a string!");
+	name = pluckToken(&parser.previous);
+      } break;
+      case TOKEN_MODE: {
+	consume(TOKEN_COLON, "Missing colon.");
+	if (match(TOKEN_TABLE)) {
+	  mode = CONSOLE_TABLE;
+	} else if (match(TOKEN_SPOOL)) {
+	  mode = CONSOLE_SPOOL;
+	} else {
+	  consume(TOKEN_TEXT, "Console mode can only be 'text', 'table' or 'spool'!");
+	  mode = CONSOLE_TEXT;
+	}
+      } break;
+      case TOKEN_SEPARATOR: {
+	consume(TOKEN_COLON, "Missing colon.");
+	consume(TOKEN_STRING, "Separator must be a string!");
+	separator = unescapeString(pluckToken(&parser.previous));
+	if (separator[0] == '\0') error("Separator can't be empty!");
+      } break;
+      case TOKEN_SEARCH: {
+	consume(TOKEN_COLON, "Missing colon.");
+	if (!match(TOKEN_TRUE)) {
+	  consume(TOKEN_FALSE, "'search' can only be true or false!");
+	}
+	hasSearch = parser.previous.type == TOKEN_TRUE;
+      } break;
+      default: error("Invalid keyword for console description.");
+      }
 
-  GtkWidget *textview;
-  GtkWidget *scrollwindow;
+      if (!check(TOKEN_CLOSE_OBJECT)) consume(TOKEN_COMMA, "Missing comma.");
+    }
+  }
 
-  scrollwindow = gtk_scrolled_window_new(NULL, NULL);
-  gtk_scrolled_window_set_min_content_height(GTK_SCROLLED_WINDOW(scrollwindow), 200);
-  gtk_scrolled_window_set_min_content_width(GTK_SCROLLED_WINDOW(scrollwindow), 200);
-  textview = gtk_text_view_new_with_buffer(shell_buffer);
-  gtk_text_view_set_editable(GTK_TEXT_VIEW(textview), false);
-  gtk_container_add(GTK_CONTAINER(parent), scrollwindow);
-  gtk_container_add(GTK_CONTAINER(scrollwindow), textview);
+  if (separator != NULL && mode != CONSOLE_TABLE) error("Only table consoles take a separator!");
 
+  Console *da_console = newConsole(mode, separator);
+  if (hasSearch) addSearch(da_console);
+  gtk_container_add(GTK_CONTAINER(parent), da_console->widget);
+
+  if (name != NULL) {
+    bool success = setWidget(name, da_console->widget) && setConsole(name, da_console);
+    if (!success) error("Something went wrong with console naming!");
+  }
+
+  if (variable != NULL) {
+    if (mode == CONSOLE_TABLE) {
+      GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(da_console->view));
+      g_signal_connect(selection, "changed", G_CALLBACK(updateTableVariable), newBinding(variable));
+    } else {
+      g_signal_connect(da_console->buffer, "notify::cursor-position", G_CALLBACK(updateConsoleVariable), newBinding(variable));
+    }
+  }
+}
+
+static void progress(GtkWidget *parent) {
+  if (parser.headless) {
+    skipValue();
+    return;
+  }
+  GRegex *pattern = NULL;
+  char *name = NULL;
+
+  if (!match(TOKEN_NULL)) {
+    consume(TOKEN_OPEN_OBJECT, "Missing opening curly brace for progress description!");
+
+    while (!match(TOKEN_CLOSE_OBJECT)) {
+      advance();
+      switch (parser.previous.type) {
+      case TOKEN_NAME: {
+	consume(TOKEN_COLON, "Missing colon.");
+	consume(TOKEN_STRING, "Widget name must be a string!");
+	name = pluckToken(&parser.previous);
+      } break;
+      case TOKEN_PATTERN: {
+	consume(TOKEN_COLON, "Missing colon.");
+	consume(TOKEN_STRING, "Pattern must be a string!");
+	GError *regexError = NULL;
+	pattern = g_regex_new(pluckToken(&parser.previous), G_REGEX_OPTIMIZE, 0, &regexError);
+	if (pattern == NULL) {
+	  fprintf(stderr, "%s\n", regexError->message);
+	  g_error_free(regexError);
+	  error("Invalid progress pattern.");
+	} else if (g_regex_get_capture_count(pattern) < 1) {
+	  error("Progress pattern needs a group around the number!");
+	}
+      } break;
+      default: error("Invalid keyword for progress description.");
+      }
+
+      if (!check(TOKEN_CLOSE_OBJECT)) consume(TOKEN_COMMA, "Missing comma.");
+    }
+  }
+
+  Progress *da_progress = newProgress(pattern);
+  gtk_container_add(GTK_CONTAINER(parent), da_progress->widget);
+  if (name != NULL && !setWidget(name, da_progress->widget)) error("Something went wrong with widget naming!");
+}
+
+static int count() {
+  consume(TOKEN_NUMBER, "Expected a number.");
+  int value = (int) strtol(parser.previous.start, NULL, 10);
+  if (value < 1) error("Counting starts from 1!");
+  return value;
+}
+
+static void output(Command *command) {
+  if (match(TOKEN_STRING)) {
+    command->output = pluckToken(&parser.previous);
+    return;
+  }
+
+  consume(TOKEN_OPEN_OBJECT, "Output must be a variable name or an object!");
   while (!match(TOKEN_CLOSE_OBJECT)) {
     advance();
     switch (parser.previous.type) {
     case TOKEN_VARIABLE: {
       consume(TOKEN_COLON, "Missing colon.");
-      consume(TOKEN_STRING, "Invalid variable name");
-
-      char *variable = pluckToken(&parser.previous);
-      g_signal_connect(shell_buffer, "notify::cursor-position", G_CALLBACK(updateConsoleVariable), variable);
+      consume(TOKEN_STRING, "Invalid variable name.");
+      command->output = pluckToken(&parser.previous);
+    } break;
+    case TOKEN_LINE: {
+      consume(TOKEN_COLON, "Missing colon.");
+      command->outputLine = count();
+    } break;
+    case TOKEN_FIELD: {
+      consume(TOKEN_COLON, "Missing colon.");
+      command->outputField = count();
+    } break;
+    case TOKEN_SEPARATOR: {
+      consume(TOKEN_COLON, "Missing colon.");
+      consume(TOKEN_STRING, "Separator must be a string!");
+      command->outputSeparator = unescapeString(pluckToken(&parser.previous));
+      if (command->outputSeparator[0] == '\0') error("Separator can't be empty!");
     } break;
-    default: error("Invalid keyword for console description.");
+    default: error("Invalid keyword for output description.");
     }
+
+    if (!check(TOKEN_CLOSE_OBJECT)) consume(TOKEN_COMMA, "Missing comma.");
   }
+
+  if (command->output == NULL) error("Output with no variable!");
+}
+
+static void prerequisites(Command *command) {
+  /* Button names, looked up when the button is clicked, so they may come later in the file. */
+  consume(TOKEN_OPEN_ARRAY, "Expected a list of button names.");
+  while (!match(TOKEN_CLOSE_ARRAY)) {
+    consume(TOKEN_STRING, "Button names must be strings!");
+    command->after = realloc(command->after, sizeof(char *) * (command->afterCount + 1));
+    if (command->after == NULL) {
+      fprintf(stderr, "Ran out of memory reading button names.\n");
+      exit(1);
+    }
+    command->after[command->afterCount++] = pluckToken(&parser.previous);
+    if (!check(TOKEN_CLOSE_ARRAY)) consume(TOKEN_COMMA, "Missing comma.");
+  }
+}
+
+static Concurrency concurrency() {
+  advance();
+  switch (parser.previous.type) {
+  case TOKEN_PARALLEL: return CONCURRENCY_PARALLEL;
+  case TOKEN_QUEUE: return CONCURRENCY_QUEUE;
+  case TOKEN_DROP: return CONCURRENCY_DROP;
+  case TOKEN_RESTART: return CONCURRENCY_RESTART;
+  default: error("Concurrency must be parallel, queue, drop or restart!");
+  }
+  return CONCURRENCY_PARALLEL;
 }
 
 static void button(GtkWidget *parent) {
@@ -306,14 +587,20 @@ static void button(GtkWidget *parent) {
 
   bool hasLabel = false;
   bool hasCommand = false;
+  bool isExit = false;
+  bool isSave = false;
 
-  GtkWidget *button;
+  GtkWidget *button = NULL;
   GtkWidget *button_box;
+  Command *da_command = newCommand(NULL);
+  char *name = NULL;
 
-  button_box = gtk_button_box_new(GTK_ORIENTATION_HORIZONTAL);
-  gtk_container_add(GTK_CONTAINER(parent), button_box);
+  if (!parser.headless) {
+    button_box = gtk_button_box_new(GTK_ORIENTATION_HORIZONTAL);
+    gtk_container_add(GTK_CONTAINER(parent), button_box);
 
-  button = gtk_button_new();
+    button = gtk_button_new();
+  }
   
   while (!match(TOKEN_CLOSE_OBJECT)) {
     advance();
@@ -331,18 +618,76 @@ static void button(GtkWidget *parent) {
       if (hasCommand) error("Buttons can only have one command!");
       consume(TOKEN_COLON, "Missing colon.");
       if (match(TOKEN_EXIT)) {
-	g_signal_connect_swapped(button, "clicked", G_CALLBACK(gtk_widget_destroy), main_window);
+	if (!parser.headless) g_signal_connect_swapped(button, "clicked", G_CALLBACK(gtk_widget_destroy), main_window);
+	isExit = true;
+      } else if (match(TOKEN_SAVE)) {
+	isSave = true; /* Connected once the console is known, since it may come after. */
       } else {
 	consume(TOKEN_STRING, "Value not valid command.");
-	char *command = pluckToken(&parser.previous);
+	da_command->command = pluckToken(&parser.previous);
 	//char *commandString = parseCommand(command);
-	g_signal_connect(button, "clicked", G_CALLBACK(runCommand), command);
+	if (!parser.headless) g_signal_connect(button, "clicked", G_CALLBACK(runCommand), da_command);
       }
       hasCommand = true;
     } break;
+    case TOKEN_RUN: {
+      /* A command of its own made of other buttons, each run once whatever it comes after has succeeded. */
+      if (hasCommand) error("Buttons can only have one command!");
+      consume(TOKEN_COLON, "Missing colon.");
+      int before = da_command->afterCount;
+      prerequisites(da_command);
+      if (da_command->afterCount == before) error("Nothing to run!");
+      if (!parser.headless) g_signal_connect(button, "clicked", G_CALLBACK(runCommand), da_command);
+      hasCommand = true;
+    } break;
+    case TOKEN_AFTER: {
+      consume(TOKEN_COLON, "Missing colon.");
+      prerequisites(da_command);
+    } break;
+    case TOKEN_CONSOLE: {
+      consume(TOKEN_COLON, "Missing colon.");
+      consume(TOKEN_STRING, "Console name must be a string!");
+      da_command->console = pluckToken(&parser.previous);
+    } break;
+    case TOKEN_STDIN: {
+      consume(TOKEN_COLON, "Missing colon.");
+      consume(TOKEN_STRING, "Invalid variable name.");
+      da_command->input = pluckToken(&parser.previous);
+    } break;
+    case TOKEN_STDERR: {
+      consume(TOKEN_COLON, "Missing colon.");
+      consume(TOKEN_STRING, "Console name must be a string!");
+      da_command->errors = pluckToken(&parser.previous);
+    } break;
+    case TOKEN_PROGRESS: {
+      consume(TOKEN_COLON, "Missing colon.");
+      consume(TOKEN_STRING, "Progress bar name must be a string!");
+      da_command->progress = pluckToken(&parser.previous);
+    } break;
+    case TOKEN_OUTPUT: {
+      consume(TOKEN_COLON, "Missing colon.");
+      output(da_command);
+    } break;
+    case TOKEN_CONCURRENCY: {
+      consume(TOKEN_COLON, "Missing colon.");
+      da_command->concurrency = concurrency();
+    } break;
+    case TOKEN_TIMEOUT: {
+      consume(TOKEN_COLON, "Missing colon.");
+      da_command->timeout = count();
+    } break;
+    case TOKEN_MAX_MEMORY: {
+      consume(TOKEN_COLON, "Missing colon.");
+      da_command->maxMemory = count();
+    } break;
+    case TOKEN_MAX_CPU: {
+      consume(TOKEN_COLON, "Missing colon.");
+      da_command->maxCpu = count();
+    } break;
     case TOKEN_NAME: {
       consume(TOKEN_COLON, "Missing colon.");
-      nameWidget(button);
+      consume(TOKEN_STRING, "Widget name must be a string!");
+      name = pluckToken(&parser.previous);
     } break;
     case TOKEN_ENABLE: {
       consume(TOKEN_COLON, "Missing colon.");
@@ -356,8 +701,19 @@ static void button(GtkWidget *parent) {
 
   if (!hasLabel) error("No label set for button!");
   if (!hasCommand) error("No command set for button!");
+  if ((isExit || isSave) && da_command->afterCount > 0) error("Only buttons that run commands can come after others!");
+
+  if (name != NULL) {
+    /* Named buttons that run commands can also be run from the command line. */
+    bool success = (parser.headless || setWidget(name, button)) &&
+      (isExit || isSave || setAction(name, da_command));
+    if (!success) error("Something went wrong with widget naming!");
+  }
+
+  if (isSave && !parser.headless) g_signal_connect(button, "clicked", G_CALLBACK(saveCommand), newBinding(da_command->console));
+  if (isExit || isSave) free(da_command);
 
-  gtk_container_add(GTK_CONTAINER(button_box), button);
+  if (!parser.headless) gtk_container_add(GTK_CONTAINER(button_box), button);
 }
 
 static void row(GtkWidget *parent) {
@@ -365,16 +721,18 @@ static void row(GtkWidget *parent) {
 
   bool hasEntries = false;
 
-  GtkWidget *row;
-  row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
-  gtk_container_set_border_width(GTK_CONTAINER(row), 5);
-  gtk_container_add(GTK_CONTAINER(parent), row);
+  GtkWidget *row = NULL;
+  if (!parser.headless) {
+    row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+    gtk_container_set_border_width(GTK_CONTAINER(row), 5);
+    gtk_container_add(GTK_CONTAINER(parent), row);
+  }
   
   while (!match(TOKEN_CLOSE_OBJECT)) {
     entry(row);
   }
 
-  gtk_container_foreach(GTK_CONTAINER(row), setExpandFill, row);
+  if (!parser.headless) gtk_container_foreach(GTK_CONTAINER(row), setExpandFill, row);
 }
 
 static void list(GtkWidget *parent) {
@@ -382,11 +740,12 @@ static void list(GtkWidget *parent) {
 
   bool hasEntries = false;
 
-  GtkWidget *list;
-
-  list = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
-  gtk_container_set_border_width(GTK_CONTAINER(list), 5);
-  gtk_container_add(GTK_CONTAINER(parent), list);
+  GtkWidget *list = NULL;
+  if (!parser.headless) {
+    list = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
+    gtk_container_set_border_width(GTK_CONTAINER(list), 5);
+    gtk_container_add(GTK_CONTAINER(parent), list);
+  }
 
   while (!match(TOKEN_CLOSE_OBJECT)) {
     entry(list);
@@ -400,17 +759,59 @@ static void column(GtkWidget *parent) {
 
   bool hasEntries = false;
 
-  GtkWidget *list;
-
-  list = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
-  gtk_container_set_border_width(GTK_CONTAINER(list), 5);
-  gtk_container_add(GTK_CONTAINER(parent), list);
+  GtkWidget *list = NULL;
+  if (!parser.headless) {
+    list = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
+    gtk_container_set_border_width(GTK_CONTAINER(list), 5);
+    gtk_container_add(GTK_CONTAINER(parent), list);
+  }
 
   while (!match(TOKEN_CLOSE_OBJECT)) {
     entry(list);
   }
 
-  gtk_container_foreach(GTK_CONTAINER(list), setExpandFill, list);
+  if (!parser.headless) gtk_container_foreach(GTK_CONTAINER(list), setExpandFill, list);
+}
+
+static void include(GtkWidget *parent) {
+  /* The fragment's entries go straight into the including object, config entries if parent is NULL. */
+  consume(TOKEN_STRING, "Include path must be a string!");
+  if (parser.hadError) return;
+  char *name = pluckToken(&parser.previous);
+
+  Fragment *fragment = loadFragment(name, parser.directory);
+  if (fragment == NULL) {
+    error("Could not include file.");
+    return;
+  }
+  if (fragment->including) {
+    error("File ends up including itself!");
+    return;
+  }
+
+  Parser outer = parser;
+  fragment->including = true;
+  parser.fragment = fragment;
+  parser.position = 0;
+  parser.directory = fragment->directory;
+  advance();
+
+  consume(TOKEN_OPEN_OBJECT, "Missing opening curly brace for included file.");
+  while (!check(TOKEN_EOF) && !match(TOKEN_CLOSE_OBJECT)) {
+    if (parent == NULL) {
+      config_entry();
+    } else {
+      entry(parent);
+    }
+  }
+  consume(TOKEN_EOF, "Included file continues after its object ends!");
+
+  fragment->including = false;
+  parser.current = outer.current;
+  parser.previous = outer.previous;
+  parser.fragment = outer.fragment;
+  parser.position = outer.position;
+  parser.directory = outer.directory;
 }
 
 static void window(GtkWidget *parent) {
@@ -462,6 +863,14 @@ static void entry(GtkWidget *parent) {
     consume(TOKEN_COLON, "Missing colon");
     column(parent);
   } break;
+  case TOKEN_PROGRESS: {
+    consume(TOKEN_COLON, "Missing colon.");
+    progress(parent);
+  } break;
+  case TOKEN_INCLUDE: {
+    consume(TOKEN_COLON, "Missing colon.");
+    include(parent);
+  } break;
   default: error("Invalid entry key.");
   }
   if (!check(TOKEN_CLOSE_OBJECT)) consume(TOKEN_COMMA, "Missing comma.");
@@ -473,12 +882,23 @@ static void config_entry() {
   case TOKEN_NAME: {
     consume(TOKEN_COLON, "Missing colon.");
     consume(TOKEN_STRING, "Invalid window name.");
-    gtk_window_set_title(GTK_WINDOW(main_window), pluckToken(&parser.previous));
+    if (!parser.headless) gtk_window_set_title(GTK_WINDOW(main_window), pluckToken(&parser.previous));
   } break;
   case TOKEN_VARIABLE: {
     consume(TOKEN_COLON, "Missing colon.");
     variable();
   } break;
+  case TOKEN_INCLUDE: {
+    consume(TOKEN_COLON, "Missing colon.");
+    include(NULL);
+  } break;
+  case TOKEN_ENV: {
+    consume(TOKEN_COLON, "Missing colon.");
+    if (!match(TOKEN_TRUE)) {
+      consume(TOKEN_FALSE, "'env' can only be true or false!");
+    }
+    exportVariables(parser.previous.type == TOKEN_TRUE);
+  } break;
   default: error("Invalid config key.");
   }
   if (!check(TOKEN_CLOSE_OBJECT)) consume(TOKEN_COMMA, "Missing comma.");
@@ -491,11 +911,19 @@ static void config() {
   }
 }
 
-void build(char *source, GtkWidget *app_window) {
+static bool parse(char *source, int input, const char *path, GtkWidget *app_window, bool headless) {
   main_window = app_window;
   
-  initScanner(source);
+  if (source != NULL) {
+    initScanner(source);
+  } else {
+    /* Widgets are made as their descriptions arrive, but none are drawn before the parse is over. The main loop
+       doesn't run until then, and running it from here would let handlers switch panels under the parser. */
+    initStreamScanner(input);
+  }
   initParser();
+  parser.headless = headless;
+  parser.directory = g_path_get_dirname(path);
   advance();
 
   consume(TOKEN_OPEN_OBJECT, "Missing opening curly brace for description file.");
@@ -509,8 +937,20 @@ void build(char *source, GtkWidget *app_window) {
   window(app_window);
   consume(TOKEN_CLOSE_OBJECT, "Missing closing curly brace for description file.");
   consume(TOKEN_EOF, "File continues after window object ends!");
+  freeScanner();
+  g_free(parser.directory);
   if (parser.hadError) {
     fprintf(stderr, "Parser error!\n");
-    exit(1);
+    return false;
   }
+  return true;
+}
+
+bool build(char *source, int input, const char *path, GtkWidget *app_window) {
+  return parse(source, input, path, app_window, false);
+}
+
+bool buildHeadless(char *source, int input, const char *path) {
+  /* The same file with no display: variables are declared and named buttons become actions, nothing else is made. */
+  return parse(source, input, path, NULL, true);
 }
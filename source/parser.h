@@ -1,6 +1,8 @@
 #ifndef SGIDLS_PARSER
 #define SGIDLS_PARSER
 
-extern void build(char *source, GtkWidget *app_window);
+/* The source is the whole file, or NULL to read it from input as it arrives. */
+extern bool build(char *source, int input, const char *path, GtkWidget *app_window);
+extern bool buildHeadless(char *source, int input, const char *path);
 
 #endif
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <gtk/gtk.h>
+
+#include "common.h"
+#include "progress.h"
+#include "table.h"
+
+static Progress *progressBars = NULL;
+
+static gboolean showProgress(GtkWidget *widget, GdkFrameClock *clock, gpointer data) {
+  /* Runs once per frame at most, whatever the number of lines read since the last one. */
+  Progress *progress = data;
+  gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress->widget), progress->fraction);
+  progress->tick = 0;
+  return G_SOURCE_REMOVE;
+}
+
+static void setFraction(Progress *progress, double fraction) {
+  if (fraction < 0.0) fraction = 0.0;
+  if (fraction > 1.0) fraction = 1.0;
+  progress->fraction = fraction;
+  if (progress->tick == 0) progress->tick = gtk_widget_add_tick_callback(progress->widget, showProgress, progress, NULL);
+}
+
+static bool readLine(Progress *progress, const char *chars, size_t length) {
+  /* Returns whether the line carried a value. */
+  if (progress->pattern == NULL) {
+    static const char prefix[] = "PROGRESS ";
+    if (length <= sizeof(prefix) - 1 || memcmp(chars, prefix, sizeof(prefix) - 1) != 0) return false;
+
+    char number[32];
+    size_t digits = length - (sizeof(prefix) - 1);
+    if (digits >= sizeof(number)) return false;
+    memcpy(number, chars + sizeof(prefix) - 1, digits);
+    number[digits] = '\0';
+
+    char *end;
+    double percent = g_ascii_strtod(number, &end);
+    if (end == number) return false;
+    setFraction(progress, percent / 100.0);
+    return true;
+  }
+
+  GMatchInfo *match;
+  bool found = g_regex_match_full(progress->pattern, chars, length, 0, 0, &match, NULL);
+  if (found) {
+    /* One group is a percentage, two are a count out of a total. */
+    char *first = g_match_info_fetch(match, 1);
+    char *second = g_match_info_fetch(match, 2);
+    double value = first == NULL ? 0.0 : g_ascii_strtod(first, NULL);
+    if (second != NULL && second[0] != '\0') {
+      double total = g_ascii_strtod(second, NULL);
+      setFraction(progress, total > 0.0 ? value / total : 0.0);
+    } else {
+      setFraction(progress, value / 100.0);
+    }
+    g_free(first);
+    g_free(second);
+  }
+  g_match_info_free(match);
+  return found;
+}
+
+static bool isBreak(char c) {
+  /* Progress meters usually redraw their line with a carriage return rather than starting a new one. */
+  return c == '\n' || c == '\r';
+}
+
+void progressWrite(Progress *progress, const char *chars, size_t length) {
+  const char *end = chars + length;
+  const char *first = chars;
+  while (first < end && !isBreak(*first)) first++;
+  if (first == end) {
+    g_string_append_len(progress->partial, chars, length);
+    return;
+  }
+
+  /* Only the newest value matters, so the lines in this chunk are tried from the last one back. */
+  const char *lineEnd = end;
+  while (lineEnd > first && !isBreak(lineEnd[-1])) lineEnd--;
+  const char *tail = lineEnd;
+  bool found = false;
+  while (!found && lineEnd > first + 1) {
+    const char *lineStart = lineEnd - 1;
+    while (lineStart > first + 1 && !isBreak(lineStart[-1])) lineStart--;
+    found = readLine(progress, lineStart, lineEnd - 1 - lineStart);
+    lineEnd = lineStart;
+  }
+
+  if (!found) {
+    g_string_append_len(progress->partial, chars, first - chars);
+    readLine(progress, progress->partial->str, progress->partial->len);
+  }
+  g_string_truncate(progress->partial, 0);
+  g_string_append_len(progress->partial, tail, end - tail);
+}
+
+void progressFlush(Progress *progress) {
+  if (progress->partial->len > 0) readLine(progress, progress->partial->str, progress->partial->len);
+  g_string_truncate(progress->partial, 0);
+}
+
+void progressClear(Progress *progress) {
+  g_string_truncate(progress->partial, 0);
+  setFraction(progress, 0.0);
+}
+
+Progress *findProgress(const char *name) {
+  GtkWidget *widget = getWidget(name);
+  return widget == NULL ? NULL : g_object_get_data(G_OBJECT(widget), "progress");
+}
+
+Progress *newProgress(GRegex *pattern) {
+  Progress *progress = allocate(sizeof(Progress), "Ran out of memory creating progress bar.");
+  progress->widget = gtk_progress_bar_new();
+  progress->pattern = pattern;
+  progress->partial = g_string_new(NULL);
+  progress->fraction = 0.0;
+  progress->tick = 0;
+  progress->panel = getPanel();
+  progress->next = progressBars;
+  progressBars = progress;
+  gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(progress->widget), true);
+  g_object_set_data(G_OBJECT(progress->widget), "progress", progress);
+  return progress;
+}
+
+void freePanelProgress(Panel *panel) {
+  /* The bar and its tick callback went with the window. */
+  Progress **link = &progressBars;
+  while (*link != NULL) {
+    Progress *progress = *link;
+    if (progress->panel != panel) {
+      link = &progress->next;
+      continue;
+    }
+    *link = progress->next;
+    if (progress->pattern != NULL) g_regex_unref(progress->pattern);
+    g_string_free(progress->partial, true);
+    free(progress);
+  }
+}
@@ -0,0 +1,28 @@
+#ifndef SGIDLS_PROGRESS
+#define SGIDLS_PROGRESS
+
+#include <stddef.h>
+#include <gtk/gtk.h>
+
+typedef struct Panel Panel;
+typedef struct Progress Progress;
+
+/* A progress bar that follows a command's output, either through a pattern or 'PROGRESS n' lines. */
+struct Progress {
+  GtkWidget *widget;
+  GRegex *pattern; /* NULL for the PROGRESS protocol. */
+  GString *partial; /* Unterminated trailing line, carried over to the next chunk. */
+  double fraction; /* The latest value read from the output. */
+  guint tick; /* Pending frame update, 0 when the bar is up to date. */
+  Panel *panel;
+  Progress *next; /* Every progress bar of a panel that hasn't been freed. */
+};
+
+extern Progress *newProgress(GRegex *pattern);
+extern Progress *findProgress(const char *name);
+extern void progressClear(Progress *progress);
+extern void progressWrite(Progress *progress, const char *chars, size_t length);
+extern void progressFlush(Progress *progress);
+extern void freePanelProgress(Panel *panel);
+
+#endif
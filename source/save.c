@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <gtk/gtk.h>
+
+#include "common.h"
+#include "config.h"
+#include "console.h"
+#include "latency.h"
+#include "save.h"
+#include "spool.h"
+#include "table.h"
+
+/* Saving runs entirely on GIO's asynchronous calls, one chunk at a time, so the window
+   keeps responding however much output there is. What gets written is a snapshot taken when the save
+   starts, so a command printing more or being run again meanwhile doesn't end up in the file. */
+typedef struct {
+  Console *console;
+  GFile *file;
+  GOutputStream *stream;
+
+  const char *data;
+  size_t size;
+  size_t offset;
+  bool mapped; /* The snapshot is our own mapping of the spool file, otherwise a copy in memory. */
+} Save;
+
+static void writeNext(Save *save);
+
+static void finishSave(Save *save, GError *error) {
+  if (error != NULL) {
+    char *path = g_file_get_path(save->file);
+    fprintf(stderr, "Failed saving console to '%s': %s\n", path, error->message);
+    g_free(path);
+    g_error_free(error);
+  }
+
+  if (save->mapped) {
+    munmap((void *) save->data, save->size);
+  } else {
+    free((void *) save->data);
+  }
+  if (save->stream != NULL) g_object_unref(save->stream);
+  g_object_unref(save->file);
+  releasePanel(save->console->panel);
+  free(save);
+}
+
+static void closed(GObject *source, GAsyncResult *result, gpointer data) {
+  GError *error = NULL;
+  g_output_stream_close_finish(G_OUTPUT_STREAM(source), result, &error);
+  finishSave(data, error);
+}
+
+static void written(GObject *source, GAsyncResult *result, gpointer data) {
+  Save *save = data;
+  GError *error = NULL;
+  if (!g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, NULL, &error)) {
+    finishSave(save, error);
+    return;
+  }
+  writeNext(save);
+}
+
+static void writeChunk(Save *save, const char *chars, size_t length) {
+  g_output_stream_write_all_async(save->stream, chars, length, G_PRIORITY_DEFAULT_IDLE, NULL, written, save);
+}
+
+static void writeNext(Save *save) {
+  size_t length = save->size - save->offset;
+  if (length > SAVE_CHUNK_SIZE) length = SAVE_CHUNK_SIZE;
+  if (length == 0) {
+    g_output_stream_close_async(save->stream, G_PRIORITY_DEFAULT_IDLE, NULL, closed, save);
+    return;
+  }
+  writeChunk(save, save->data + save->offset, length);
+  save->offset += length;
+}
+
+static void replaced(GObject *source, GAsyncResult *result, gpointer data) {
+  Save *save = data;
+  GError *error = NULL;
+  GFileOutputStream *stream = g_file_replace_finish(G_FILE(source), result, &error);
+  if (stream == NULL) {
+    finishSave(save, error);
+    return;
+  }
+  save->stream = G_OUTPUT_STREAM(stream);
+  writeNext(save);
+}
+
+static void snapshotSpool(Save *save, Spool *spool) {
+  /* The spool keeps growing and may be cleared while we write, so we hold on to what it had when the save started.
+     A spilled spool gets a mapping of its own, which outlives the spool closing its file. */
+  save->size = spool->size;
+  if (save->size == 0) return;
+
+  if (spool->fd != -1) {
+    void *map = mmap(NULL, save->size, PROT_READ, MAP_SHARED, spool->fd, 0);
+    if (map != MAP_FAILED) {
+      save->data = map;
+      save->mapped = true;
+      return;
+    }
+    fprintf(stderr, "Failed mapping spool file!\n");
+    save->size = 0;
+    return;
+  }
+  char *copy = allocate(save->size, "Ran out of memory saving console."); /* At most SPOOL_MEMORY_LIMIT. */
+  memcpy(copy, spool->memory, save->size);
+  save->data = copy;
+}
+
+static void snapshotText(Save *save, GtkTextBuffer *buffer) {
+  GtkTextIter start, end;
+  gtk_text_buffer_get_bounds(buffer, &start, &end);
+  char *text = gtk_text_buffer_get_text(buffer, &start, &end, true); /* Lines hidden by a filter are saved too. */
+  save->size = strlen(text);
+  save->data = text;
+}
+
+static void snapshotTable(Save *save, GtkListStore *store) {
+  /* Column 0 holds each row's line as it was printed. */
+  GtkTreeModel *model = GTK_TREE_MODEL(store);
+  GString *copy = g_string_new(NULL);
+  GtkTreeIter iter;
+  bool valid = gtk_tree_model_get_iter_first(model, &iter);
+  while (valid) {
+    char *line;
+    gtk_tree_model_get(model, &iter, 0, &line, -1);
+    g_string_append(copy, line);
+    g_string_append_c(copy, '\n');
+    g_free(line);
+    valid = gtk_tree_model_iter_next(model, &iter);
+  }
+  save->size = copy->len;
+  save->data = g_string_free(copy, false);
+}
+
+static void startSave(Console *console, GFile *file) {
+  Save *save = allocate(sizeof(Save), "Ran out of memory saving console.");
+  save->console = console;
+  save->file = file;
+  save->stream = NULL;
+  save->data = NULL;
+  save->size = 0;
+  save->offset = 0;
+  save->mapped = false;
+  holdPanel(console->panel); /* The console stays until the save is done, even if its window closes. */
+  switch (console->mode) {
+  case CONSOLE_SPOOL: snapshotSpool(save, console->spool); break;
+  case CONSOLE_TEXT: snapshotText(save, console->buffer); break;
+  case CONSOLE_TABLE: {
+    consoleFlushRows(console); /* Rows that came in since the last frame are part of what's saved too. */
+    snapshotTable(save, console->store);
+  } break;
+  }
+
+  g_file_replace_async(file, NULL, false, G_FILE_CREATE_REPLACE_DESTINATION, G_PRIORITY_DEFAULT_IDLE, NULL, replaced, save);
+}
+
+void saveConsole(Console *console, GtkWidget *parent) {
+  GtkFileChooserNative *chooser = gtk_file_chooser_native_new("Save Output", GTK_WINDOW(parent), GTK_FILE_CHOOSER_ACTION_SAVE, "_Save", "_Cancel");
+  gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(chooser), true);
+
+  if (gtk_native_dialog_run(GTK_NATIVE_DIALOG(chooser)) == GTK_RESPONSE_ACCEPT) {
+    enterHandler("saveConsole", NULL);
+    startSave(console, gtk_file_chooser_get_file(GTK_FILE_CHOOSER(chooser)));
+    leaveHandler();
+  }
+  g_object_unref(chooser);
+}
+
+void saveCommand(GtkWidget *widget, gpointer data) {
+  Binding *binding = data;
+  enterHandler("saveCommand", buttonSubject(widget, binding->key));
+  usePanel(binding->panel);
+  Console *console = findConsole(binding->key);
+  leaveHandler(); /* Before the dialog, which runs a main loop of its own. Time spent choosing a file isn't a stall. */
+  if (console == NULL) {
+    fprintf(stderr, "No console to save!\n");
+    return;
+  }
+  saveConsole(console, gtk_widget_get_toplevel(widget));
+}
@@ -0,0 +1,11 @@
+#ifndef SGIDLS_SAVE
+#define SGIDLS_SAVE
+
+#include <gtk/gtk.h>
+
+#include "console.h"
+
+extern void saveConsole(Console *console, GtkWidget *parent);
+extern void saveCommand(GtkWidget *widget, gpointer data);
+
+#endif
@@ -1,15 +1,31 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include "scanner.h"
 #include "config.h"
 
+/* A piece of a description that is read as it arrives. Each chunk ends in a NUL like a whole file would. */
+typedef struct Chunk Chunk;
+struct Chunk {
+  Chunk *next;
+  char chars[];
+};
+
 typedef struct {
   char *start;
   char *current;
   int line;
+
+  /* Only used when reading from a pipe. */
+  int input; /* -1 once it hits end of file, or when the whole source was there from the start. */
+  char *end; /* Where the bytes read so far end in the current chunk. */
+  Chunk *chunks; /* Oldest first, the last one is the current chunk. */
+  Chunk *tokenChunk; /* Holds the last token handed out, which the parser may still be looking at. */
 } Scanner;
 
 static Scanner scanner;
@@ -22,9 +38,79 @@ void initScanner(char *source) {
   scanner.start = source;
   scanner.current = source;
   scanner.line = 1;
+  scanner.input = -1;
+  scanner.end = NULL;
+  scanner.chunks = NULL;
+  scanner.tokenChunk = NULL;
+}
+
+static Chunk *lastChunk() {
+  Chunk *chunk = scanner.chunks;
+  while (chunk != NULL && chunk->next != NULL) chunk = chunk->next;
+  return chunk;
+}
+
+static void refill() {
+  /* Called when the scanner reaches the end of what has been read. The token being scanned is carried
+     over to the start of a new chunk, so tokens never straddle two chunks. */
+  if (scanner.input == -1 || scanner.current != scanner.end) return;
+
+  size_t kept = scanner.end - scanner.start;
+  Chunk *chunk = malloc(sizeof(Chunk) + kept + SCANNER_CHUNK_SIZE + 1);
+  if (chunk == NULL) {
+    fprintf(stderr, "Ran out of memory reading description.\n");
+    exit(1);
+  }
+  chunk->next = NULL;
+  memcpy(chunk->chars, scanner.start, kept);
+
+  ssize_t length;
+  do {
+    length = read(scanner.input, chunk->chars + kept, SCANNER_CHUNK_SIZE);
+  } while (length == -1 && errno == EINTR);
+  if (length == -1) fprintf(stderr, "Failed reading description: %s\n", strerror(errno));
+  if (length <= 0) {
+    length = 0;
+    scanner.input = -1;
+  }
+  chunk->chars[kept + length] = '\0';
+
+  Chunk *last = lastChunk();
+  if (last != NULL) last->next = chunk;
+  else scanner.chunks = chunk;
+  scanner.current = chunk->chars + (scanner.current - scanner.start);
+  scanner.start = chunk->chars;
+  scanner.end = chunk->chars + kept + length;
+}
+
+void initStreamScanner(int input) {
+  initScanner(NULL);
+  scanner.input = input;
+  refill(); /* Sets start, current and end. */
+  scanner.tokenChunk = scanner.chunks;
+}
+
+static void releaseChunks(Chunk *keep) {
+  /* Frees the chunks before the given one, no token the parser holds points into them any more. */
+  while (scanner.chunks != NULL && scanner.chunks != keep) {
+    Chunk *next = scanner.chunks->next;
+    free(scanner.chunks);
+    scanner.chunks = next;
+  }
+}
+
+void freeScanner() {
+  releaseChunks(NULL);
+  scanner.tokenChunk = NULL;
 }
 
 static Token makeToken(tokenType type) {
+  if (scanner.chunks != NULL) {
+    /* The parser only ever looks at this token and the one before it. */
+    releaseChunks(scanner.tokenChunk);
+    scanner.tokenChunk = lastChunk();
+  }
+
   Token token;
   token.type = type;
   token.start = scanner.start;
@@ -45,6 +131,7 @@ static Token errorToken(char *message) {
 }
 
 static bool isAtEnd() {
+  if (*scanner.current == '\0') refill();
   return *scanner.current == '\0';
 }
 
@@ -61,11 +148,24 @@ static int match(char expected) {
 }
 
 static char peek() {
+  if (*scanner.current == '\0') refill();
   return *scanner.current;
 }
 
+static char peekNext() {
+  if (isAtEnd()) return '\0';
+  if (scanner.current[1] == '\0' && scanner.current + 1 == scanner.end) {
+    /* Step onto the end so the refill has something to carry over, then step back. */
+    scanner.current++;
+    refill();
+    scanner.current--;
+  }
+  return scanner.current[1];
+}
+
 static void skipWhitespace() {
   while (true) {
+    scanner.start = scanner.current; /* So a refill doesn't carry whitespace and comments over. */
     char c = peek();
     switch (c) {
     case ' ':
@@ -78,7 +178,10 @@ static void skipWhitespace() {
       scanner.line++;
       break;
     case '#': /* Comments */
-      while (peek() != '\n' && !isAtEnd()) advance(); /* Consume all characters except for \n in a comment */
+      while (peek() != '\n' && !isAtEnd()) { /* Consume all characters except for \n in a comment */
+        advance();
+        scanner.start = scanner.current;
+      }
       break;
     default:
       return;
@@ -127,35 +230,86 @@ static tokenType keywordType() {
   if (scanner.current - scanner.start == 1) return TOKEN_ERROR; /* No single character keywords. And I mean it!*/
 
   switch (*scanner.start) {
+  case 'a': return checkKeyword(1, 4, "fter", TOKEN_AFTER);
   case 'b': return checkKeyword(1, 5, "utton", TOKEN_BUTTON);
   case 'c': switch (scanner.start[1]) {
     case 'h': return checkKeyword(2, 7, "ecklist", TOKEN_CHECKLIST);
     case 'o': switch (scanner.start[2]) {
       case 'l': return checkKeyword(3, 3, "umn", TOKEN_COLUMN);
-      case 'm': return checkKeyword(3, 4, "mand", TOKEN_COMMAND);
+      case 'm': switch (scanner.start[3]) {
+	case 'm': return checkKeyword(4, 3, "and", TOKEN_COMMAND);
+	case 'p': return checkKeyword(4, 6, "letion", TOKEN_COMPLETION);
+	} break;
       case 'n': switch (scanner.start[3]) {
+	case 'c': return checkKeyword(4, 7, "urrency", TOKEN_CONCURRENCY);
 	case 'f': return checkKeyword(4, 2, "ig", TOKEN_CONFIG);
 	case 's': return checkKeyword(4, 3, "ole", TOKEN_CONSOLE);
 	} break;
       } break;
     } break;
+  case 'd': return checkKeyword(1, 3, "rop", TOKEN_DROP);
   case 'e': switch (scanner.start[1]) {
-    case 'n': return checkKeyword(2, 4, "able", TOKEN_ENABLE);
+    case 'n': /* 'env' and 'enable' share a prefix too. */
+      if (scanner.current - scanner.start == 3) return checkKeyword(2, 1, "v", TOKEN_ENV);
+      return checkKeyword(2, 4, "able", TOKEN_ENABLE);
     case 'x': return checkKeyword(2, 2, "it", TOKEN_EXIT);
     } break;
-  case 'f': return checkKeyword(1, 4, "alse", TOKEN_FALSE);
+  case 'f': switch (scanner.start[1]) {
+    case 'a': return checkKeyword(2, 3, "lse", TOKEN_FALSE);
+    case 'i': return checkKeyword(2, 3, "eld", TOKEN_FIELD);
+    } break;
   case 'h': return checkKeyword(1, 4, "line", TOKEN_HLINE);
+  case 'i': return checkKeyword(1, 6, "nclude", TOKEN_INCLUDE);
   case 'l': switch (scanner.start[1]) {
     case 'a': return checkKeyword(2, 3, "bel", TOKEN_LABEL);
-    case 'i': return checkKeyword(2, 2, "st", TOKEN_LIST);
+    case 'i': switch (scanner.start[2]) {
+      case 'n': return checkKeyword(3, 1, "e", TOKEN_LINE);
+      case 's': return checkKeyword(3, 1, "t", TOKEN_LIST);
+      } break;
+    } break;
+  case 'm': switch (scanner.start[1]) {
+    case 'a': /* 'max-cpu' and 'max-memory' */
+      if (scanner.current - scanner.start > 4 && scanner.start[4] == 'c') return checkKeyword(1, 6, "ax-cpu", TOKEN_MAX_CPU);
+      return checkKeyword(1, 9, "ax-memory", TOKEN_MAX_MEMORY);
+    case 'o': return checkKeyword(2, 2, "de", TOKEN_MODE);
     } break;
   case 'n': switch (scanner.start[1]) {
     case 'u': return checkKeyword(2, 2, "ll", TOKEN_NULL);
     case 'a': return checkKeyword(2, 2, "me", TOKEN_NAME);
     } break;
-  case 'r': return checkKeyword(1, 2, "ow", TOKEN_ROW);
+  case 'o': return checkKeyword(1, 5, "utput", TOKEN_OUTPUT);
+  case 'p': switch (scanner.start[1]) {
+    case 'a': switch (scanner.start[2]) {
+      case 'r': return checkKeyword(3, 5, "allel", TOKEN_PARALLEL);
+      case 't': return checkKeyword(3, 4, "tern", TOKEN_PATTERN);
+      } break;
+    case 'r': return checkKeyword(2, 6, "ogress", TOKEN_PROGRESS);
+    } break;
+  case 'q': return checkKeyword(1, 4, "ueue", TOKEN_QUEUE);
+  case 'r': switch (scanner.start[1]) {
+    case 'e': return checkKeyword(2, 5, "start", TOKEN_RESTART);
+    case 'o': return checkKeyword(2, 1, "w", TOKEN_ROW);
+    case 'u': return checkKeyword(2, 1, "n", TOKEN_RUN);
+    } break;
+  case 's': switch (scanner.start[1]) {
+    case 'a': return checkKeyword(2, 2, "ve", TOKEN_SAVE);
+    case 'e': switch (scanner.start[2]) {
+      case 'a': return checkKeyword(3, 3, "rch", TOKEN_SEARCH);
+      case 'p': return checkKeyword(3, 6, "arator", TOKEN_SEPARATOR);
+      } break;
+    case 'o': return checkKeyword(2, 4, "urce", TOKEN_SOURCE);
+    case 'p': return checkKeyword(2, 3, "ool", TOKEN_SPOOL);
+    case 't': switch (scanner.start[3]) {
+      case 'e': return checkKeyword(2, 4, "derr", TOKEN_STDERR);
+      case 'i': return checkKeyword(2, 3, "din", TOKEN_STDIN);
+      } break;
+    } break;
   case 't': switch (scanner.start[1]) {
-    case 'e': return checkKeyword(2, 5, "xtbox", TOKEN_TEXTBOX);
+    case 'a': return checkKeyword(2, 3, "ble", TOKEN_TABLE);
+    case 'i': return checkKeyword(2, 5, "meout", TOKEN_TIMEOUT);
+    case 'e': /* 'text' is a prefix of 'textbox', so tell them apart by length. */
+      if (scanner.current - scanner.start == 4) return checkKeyword(2, 2, "xt", TOKEN_TEXT);
+      return checkKeyword(2, 5, "xtbox", TOKEN_TEXTBOX);
     case 'r': return checkKeyword(2, 2, "ue", TOKEN_TRUE);
   } break;
   case 'v': switch (scanner.start[1]) {
@@ -169,7 +323,8 @@ static tokenType keywordType() {
 }
 
 static Token keyword() {
-  while (isAlpha(peek()) || isDigit(peek())) advance();
+  /* Dashes join words, as in 'max-memory'. */
+  while (isAlpha(peek()) || isDigit(peek()) || (peek() == '-' && isAlpha(peekNext()))) advance();
 
   tokenType type = keywordType();
 
@@ -201,3 +356,30 @@ Token scanToken() {
 
   return errorToken("Unexpected character.");
 }
+
+Token *scanTokens(char *source, int *count) {
+  /* Scans a whole file into an array ending in TOKEN_EOF, leaving the scanner where it was,
+     since this runs in the middle of parsing the file that includes it. */
+  Scanner saved = scanner;
+  initScanner(source);
+
+  int capacity = 0;
+  Token *tokens = NULL;
+  Token token;
+  *count = 0;
+  do {
+    if (*count == capacity) {
+      capacity = capacity < 64 ? 64 : capacity * 2;
+      tokens = realloc(tokens, sizeof(Token) * capacity);
+      if (tokens == NULL) {
+        fprintf(stderr, "Ran out of memory scanning included file.\n");
+        exit(1);
+      }
+    }
+    token = scanToken();
+    tokens[(*count)++] = token;
+  } while (token.type != TOKEN_EOF);
+
+  scanner = saved;
+  return tokens;
+}
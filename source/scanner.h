@@ -14,6 +14,13 @@ typedef enum {
   TOKEN_BUTTON, TOKEN_LABEL, TOKEN_COMMAND, TOKEN_EXIT, TOKEN_LIST, TOKEN_NAME,
   TOKEN_VARIABLE, TOKEN_WINDOW, TOKEN_CONFIG, TOKEN_CHECKLIST, TOKEN_ENABLE,
   TOKEN_TEXTBOX, TOKEN_HLINE, TOKEN_CONSOLE, TOKEN_ROW, TOKEN_VLINE, TOKEN_COLUMN,
+  TOKEN_MODE, TOKEN_TEXT, TOKEN_TABLE, TOKEN_SEPARATOR, TOKEN_SPOOL,
+  TOKEN_SEARCH, TOKEN_STDIN, TOKEN_STDERR, TOKEN_INCLUDE,
+  TOKEN_SOURCE, TOKEN_PROGRESS, TOKEN_PATTERN,
+  TOKEN_OUTPUT, TOKEN_LINE, TOKEN_FIELD, TOKEN_SAVE,
+  TOKEN_ENV, TOKEN_CONCURRENCY, TOKEN_QUEUE, TOKEN_DROP, TOKEN_RESTART, TOKEN_PARALLEL,
+  TOKEN_TIMEOUT, TOKEN_MAX_MEMORY, TOKEN_MAX_CPU, TOKEN_COMPLETION,
+  TOKEN_AFTER, TOKEN_RUN,
   
   /* Literals */
   TOKEN_STRING, TOKEN_NUMBER, TOKEN_TRUE, TOKEN_FALSE,
@@ -31,6 +38,9 @@ typedef struct {
 
 void printToken(Token *token);
 void initScanner(char *source);
+void initStreamScanner(int input);
+void freeScanner();
 Token scanToken();
+Token *scanTokens(char *source, int *count);
 
 #endif
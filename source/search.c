@@ -0,0 +1,352 @@
+#define _GNU_SOURCE /* memmem */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "config.h"
+#include "console.h"
+#include "latency.h"
+#include "search.h"
+#include "spool.h"
+
+static void addMatch(Search *search, size_t line) {
+  if (search->count == search->capacity) {
+    search->capacity = search->capacity < 64 ? 64 : search->capacity * 2;
+    search->matches = realloc(search->matches, sizeof(size_t) * search->capacity);
+    if (search->matches == NULL) {
+      fprintf(stderr, "Ran out of memory indexing search results.\n");
+      exit(1);
+    }
+  }
+  search->matches[search->count++] = line;
+}
+
+static size_t nextMatch(Search *search, size_t line) {
+  /* First match after the given line, wrapping around to the first one. */
+  size_t low = 0;
+  size_t high = search->count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (search->matches[middle] <= line) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return search->matches[low == search->count ? 0 : low];
+}
+
+bool searchFiltering(Console *console) {
+  return console->search != NULL && console->search->filter && console->search->query != NULL;
+}
+
+static size_t completeLines(Console *console) {
+  /* The last line of a running command may still be growing, so it waits until the command is done. */
+  bool finished = console->search->finished;
+  switch (console->mode) {
+  case CONSOLE_TEXT: {
+    size_t count = gtk_text_buffer_get_line_count(console->buffer);
+    return finished ? count : count - 1;
+  }
+  case CONSOLE_SPOOL: return finished ? spoolLineCount(console->spool) : console->spool->lines;
+  case CONSOLE_TABLE: break;
+  }
+  return 0;
+}
+
+/* Text mode */
+
+static void lineIter(GtkTextBuffer *buffer, size_t line, GtkTextIter *iter) {
+  if (line >= (size_t) gtk_text_buffer_get_line_count(buffer)) {
+    gtk_text_buffer_get_end_iter(buffer, iter);
+  } else {
+    gtk_text_buffer_get_iter_at_line(buffer, iter, line);
+  }
+}
+
+static void lineEndIter(GtkTextIter *iter) {
+  if (!gtk_text_iter_ends_line(iter)) gtk_text_iter_forward_to_line_end(iter);
+}
+
+static void hideLines(Console *console, size_t from, size_t to) {
+  if (from >= to) return;
+
+  GtkTextIter start, end;
+  lineIter(console->buffer, from, &start);
+  lineIter(console->buffer, to, &end);
+  gtk_text_buffer_apply_tag_by_name(console->buffer, "filtered", &start, &end);
+}
+
+static bool highlight(Console *console, GtkTextIter *start, GtkTextIter *limit) {
+  GtkTextIter iter = *start;
+  GtkTextIter matchStart, matchEnd;
+  bool found = false;
+
+  while (gtk_text_iter_forward_search(&iter, console->search->query, GTK_TEXT_SEARCH_TEXT_ONLY, &matchStart, &matchEnd, limit)) {
+    gtk_text_buffer_apply_tag_by_name(console->buffer, "match", &matchStart, &matchEnd);
+    found = true;
+    iter = matchEnd;
+  }
+
+  return found;
+}
+
+static void scanText(Console *console, size_t limitLine) {
+  Search *search = console->search;
+  GtkTextIter iter, limit, matchStart, matchEnd;
+  lineIter(console->buffer, search->scanned, &iter);
+  lineIter(console->buffer, limitLine, &limit);
+
+  /* GTK's own search jumps from match to match, so lines that don't match are never copied out of the buffer. */
+  size_t shown = search->scanned;
+  while (gtk_text_iter_forward_search(&iter, search->query, GTK_TEXT_SEARCH_TEXT_ONLY, &matchStart, &matchEnd, &limit)) {
+    size_t line = gtk_text_iter_get_line(&matchStart);
+    GtkTextIter lineEnd = matchStart;
+    lineEndIter(&lineEnd);
+
+    highlight(console, &matchStart, &lineEnd);
+    addMatch(search, line);
+    if (search->filter) hideLines(console, shown, line);
+    shown = line + 1;
+    iter = lineEnd;
+  }
+
+  if (search->filter) hideLines(console, shown, limitLine);
+  search->scanned = limitLine;
+}
+
+static void repaintText(Console *console) {
+  /* Redraws the highlights and hidden lines from the match list, dropping matches that no longer match. */
+  Search *search = console->search;
+  GtkTextIter start, end;
+  gtk_text_buffer_get_bounds(console->buffer, &start, &end);
+  gtk_text_buffer_remove_tag_by_name(console->buffer, "match", &start, &end);
+  gtk_text_buffer_remove_tag_by_name(console->buffer, "filtered", &start, &end);
+  if (search->query == NULL) return;
+
+  size_t kept = 0;
+  size_t shown = 0;
+  for (size_t i = 0; i < search->count; i++) {
+    size_t line = search->matches[i];
+    GtkTextIter lineStart, lineEnd;
+    lineIter(console->buffer, line, &lineStart);
+    lineEnd = lineStart;
+    lineEndIter(&lineEnd);
+
+    if (!highlight(console, &lineStart, &lineEnd)) continue;
+    search->matches[kept++] = line;
+    if (search->filter) hideLines(console, shown, line);
+    shown = line + 1;
+  }
+  search->count = kept;
+
+  if (search->filter) hideLines(console, shown, search->scanned);
+}
+
+static void jumpText(Console *console) {
+  GtkTextIter iter;
+  gtk_text_buffer_get_iter_at_mark(console->buffer, &iter, gtk_text_buffer_get_insert(console->buffer));
+  size_t line = nextMatch(console->search, gtk_text_iter_get_line(&iter));
+
+  gtk_text_buffer_get_iter_at_line(console->buffer, &iter, line);
+  gtk_text_buffer_place_cursor(console->buffer, &iter);
+  gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(console->view), gtk_text_buffer_get_insert(console->buffer), 0.0, true, 0.0, 0.5);
+}
+
+/* Spool mode */
+
+static bool lineMatches(const char *chars, size_t length, const char *query) {
+  return chars != NULL && memmem(chars, length, query, strlen(query)) != NULL;
+}
+
+static void scanSpool(Console *console, size_t limitLine) {
+  Search *search = console->search;
+  for (size_t line = search->scanned; line < limitLine; line++) {
+    size_t length;
+    const char *chars = spoolLine(console->spool, line, &length);
+    if (lineMatches(chars, length, search->query)) addMatch(search, line);
+  }
+  search->scanned = limitLine;
+}
+
+static void narrowSpool(Console *console) {
+  Search *search = console->search;
+  size_t kept = 0;
+  for (size_t i = 0; i < search->count; i++) {
+    size_t length;
+    const char *chars = spoolLine(console->spool, search->matches[i], &length);
+    if (lineMatches(chars, length, search->query)) search->matches[kept++] = search->matches[i];
+  }
+  search->count = kept;
+}
+
+static void jumpSpool(Console *console) {
+  if (console->search->filter) return; /* Every line on screen is already a match. */
+  size_t top = gtk_adjustment_get_value(console->adjustment);
+  gtk_adjustment_set_value(console->adjustment, nextMatch(console->search, top));
+}
+
+void searchRendered(Console *console) {
+  /* A spool console only holds the lines on screen, so highlighting them is cheap. */
+  if (console->search->query == NULL) return;
+
+  GtkTextIter start, end;
+  gtk_text_buffer_get_bounds(console->buffer, &start, &end);
+  highlight(console, &start, &end);
+}
+
+/* Table mode */
+
+static gboolean rowVisible(GtkTreeModel *model, GtkTreeIter *iter, gpointer data) {
+  Console *console = data;
+  char *query = console->search->query;
+  if (query == NULL) return true;
+
+  char *line = NULL;
+  gtk_tree_model_get(model, iter, 0, &line, -1);
+  bool visible = line != NULL && strstr(line, query) != NULL;
+  g_free(line);
+  return visible;
+}
+
+/* Signal handlers */
+
+static void scan(Console *console) {
+  switch (console->mode) {
+  case CONSOLE_TEXT: scanText(console, completeLines(console)); break;
+  case CONSOLE_SPOOL: scanSpool(console, completeLines(console)); break;
+  case CONSOLE_TABLE: break; /* The filter model checks new rows as they are inserted. */
+  }
+}
+
+static void searchChanged(GtkSearchEntry *entry, gpointer data) {
+  Console *console = data;
+  Search *search = console->search;
+  const char *text = gtk_entry_get_text(GTK_ENTRY(entry));
+  enterHandler("searchChanged", text);
+
+  /* Any line containing the new query also contains the old one when the new query extends it. */
+  char *old = search->query;
+  bool narrowing = old != NULL && text[0] != '\0' && strstr(text, old) != NULL;
+  search->query = text[0] == '\0' ? NULL : g_strdup(text);
+  g_free(old);
+
+  if (console->mode == CONSOLE_TABLE) {
+    gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(search->filterModel));
+    leaveHandler();
+    return;
+  }
+
+  if (!narrowing) {
+    search->count = 0;
+    search->scanned = 0;
+  }
+
+  if (console->mode == CONSOLE_TEXT) {
+    repaintText(console);
+    if (!narrowing && search->query != NULL) scan(console);
+  } else {
+    if (narrowing) {
+      narrowSpool(console);
+    } else if (search->query != NULL) {
+      scan(console);
+    }
+    consoleRefresh(console);
+  }
+  leaveHandler();
+}
+
+static void searchNext(GtkEntry *entry, gpointer data) {
+  Console *console = data;
+  if (console->search->query == NULL || console->search->count == 0) return;
+
+  enterHandler("searchNext", console->search->query);
+  switch (console->mode) {
+  case CONSOLE_TEXT: jumpText(console); break;
+  case CONSOLE_SPOOL: jumpSpool(console); break;
+  case CONSOLE_TABLE: break;
+  }
+  leaveHandler();
+}
+
+static void filterToggled(GtkToggleButton *toggle, gpointer data) {
+  Console *console = data;
+  enterHandler("filterToggled", console->search->query);
+  console->search->filter = gtk_toggle_button_get_active(toggle);
+
+  if (console->mode == CONSOLE_TEXT) {
+    repaintText(console);
+  } else {
+    consoleRefresh(console);
+  }
+  leaveHandler();
+}
+
+void searchAppended(Console *console) {
+  if (console->search->query != NULL) scan(console);
+}
+
+void searchFinished(Console *console) {
+  console->search->finished = true;
+  if (console->search->query != NULL) scan(console);
+}
+
+void searchCleared(Console *console) {
+  console->search->finished = false;
+  console->search->scanned = 0;
+  console->search->count = 0;
+}
+
+void freeSearch(Console *console) {
+  /* The entry and the views went with the window, the filter model is the one reference we still hold. */
+  Search *search = console->search;
+  g_free(search->query);
+  free(search->matches);
+  if (search->filterModel != NULL) g_object_unref(search->filterModel);
+  free(search);
+  console->search = NULL;
+}
+
+void addSearch(Console *console) {
+  Search *search = allocate(sizeof(Search), "Ran out of memory creating search bar.");
+  search->query = NULL;
+  search->filter = false;
+  search->finished = false;
+  search->scanned = 0;
+  search->matches = NULL;
+  search->count = 0;
+  search->capacity = 0;
+  search->filterModel = NULL;
+  console->search = search;
+
+  GtkWidget *bar = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+  search->entry = gtk_search_entry_new();
+  gtk_box_pack_start(GTK_BOX(bar), search->entry, true, true, 0);
+  g_signal_connect(search->entry, "search-changed", G_CALLBACK(searchChanged), console);
+  g_signal_connect(search->entry, "activate", G_CALLBACK(searchNext), console);
+
+  if (console->mode == CONSOLE_TABLE) {
+    /* Tables always filter. The sort model sits on top so the columns can still be sorted. */
+    search->filterModel = gtk_tree_model_filter_new(GTK_TREE_MODEL(console->store), NULL);
+    gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(search->filterModel), rowVisible, console, NULL);
+    GtkTreeModel *sorted = gtk_tree_model_sort_new_with_model(search->filterModel);
+    gtk_tree_view_set_model(GTK_TREE_VIEW(console->view), sorted);
+    g_object_unref(sorted);
+  } else {
+    GtkWidget *toggle = gtk_check_button_new_with_label("Filter");
+    gtk_box_pack_start(GTK_BOX(bar), toggle, false, false, 0);
+    g_signal_connect(toggle, "toggled", G_CALLBACK(filterToggled), console);
+
+    gtk_text_buffer_create_tag(console->buffer, "match", "background", "yellow", "foreground", "black", NULL);
+    gtk_text_buffer_create_tag(console->buffer, "filtered", "invisible", true, NULL);
+  }
+
+  GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
+  gtk_box_pack_start(GTK_BOX(box), bar, false, false, 0);
+  gtk_box_pack_start(GTK_BOX(box), console->widget, true, true, 0);
+  console->widget = box;
+}
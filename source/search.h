@@ -0,0 +1,34 @@
+#ifndef SGIDLS_SEARCH
+#define SGIDLS_SEARCH
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <gtk/gtk.h>
+
+#include "console.h"
+
+struct Search {
+  GtkWidget *entry;
+  char *query; /* NULL while the search entry is empty. */
+  bool filter; /* Hide lines that don't match instead of highlighting the ones that do. */
+  bool finished; /* The command is done, so its last line won't grow any further. */
+
+  /* Lines already checked against the query. New output only ever gets checked from here on,
+     and a query that extends the previous one only rechecks lines that already matched. */
+  size_t scanned;
+  size_t *matches; /* Ascending line numbers. */
+  size_t count;
+  size_t capacity;
+
+  GtkTreeModel *filterModel; /* Table mode */
+};
+
+extern void addSearch(Console *console);
+extern void searchAppended(Console *console);
+extern void searchFinished(Console *console);
+extern void searchCleared(Console *console);
+extern void searchRendered(Console *console);
+extern bool searchFiltering(Console *console);
+extern void freeSearch(Console *console);
+
+#endif
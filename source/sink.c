@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ansi.h"
+#include "sink.h"
+#include "spool.h"
+#include "utf8.h"
+
+typedef struct {
+  Pipeline *pipeline;
+  bool isError;
+} Stream;
+
+void initPipeline(Pipeline *pipeline, Sink sink) {
+  pipeline->sink = sink;
+  initUtf8(&pipeline->outputUtf8);
+  initUtf8(&pipeline->errorUtf8);
+  initAnsi(&pipeline->outputAnsi);
+  initAnsi(&pipeline->errorAnsi);
+}
+
+void resetPipeline(Pipeline *pipeline) {
+  resetUtf8(&pipeline->outputUtf8);
+  resetUtf8(&pipeline->errorUtf8);
+  initAnsi(&pipeline->outputAnsi);
+  initAnsi(&pipeline->errorAnsi);
+}
+
+void freePipeline(Pipeline *pipeline) {
+  freeUtf8(&pipeline->outputUtf8);
+  freeUtf8(&pipeline->errorUtf8);
+}
+
+static void streamRun(void *data, const AnsiStyle *style, const char *chars, size_t length) {
+  Stream *stream = data;
+  Sink *sink = &stream->pipeline->sink;
+  sink->run(sink->data, style, chars, length, stream->isError);
+}
+
+static void parseStream(Pipeline *pipeline, const char *chars, size_t length, bool isError) {
+  Stream stream = {pipeline, isError};
+  ansiParse(isError ? &pipeline->errorAnsi : &pipeline->outputAnsi, chars, length, streamRun, &stream);
+}
+
+void pipelineWrite(Pipeline *pipeline, const char *chars, size_t length, bool isError) {
+  size_t repairedLength;
+  const char *repaired = utf8Repair(isError ? &pipeline->errorUtf8 : &pipeline->outputUtf8, chars, length, &repairedLength);
+  parseStream(pipeline, repaired, repairedLength, isError);
+}
+
+void pipelineFlush(Pipeline *pipeline) {
+  /* A stream that ends partway through a character still shows that something was there. */
+  size_t length;
+  const char *cut = utf8Flush(&pipeline->outputUtf8, &length);
+  if (cut != NULL) parseStream(pipeline, cut, length, false);
+  cut = utf8Flush(&pipeline->errorUtf8, &length);
+  if (cut != NULL) parseStream(pipeline, cut, length, true);
+}
+
+/* Null sink */
+
+static void nullRun(void *data, const AnsiStyle *style, const char *chars, size_t length, bool isError) {
+}
+
+Sink nullSink() {
+  return (Sink) {nullRun, NULL};
+}
+
+/* Memory sink */
+
+static size_t countLines(const char *chars, size_t length) {
+  size_t lines = 0;
+  const char *end = chars + length;
+  while ((chars = memchr(chars, '\n', end - chars)) != NULL) {
+    lines++;
+    chars++;
+  }
+  return lines;
+}
+
+static void memoryRun(void *data, const AnsiStyle *style, const char *chars, size_t length, bool isError) {
+  MemorySink *memory = data;
+  if (memory->length + length > memory->capacity) {
+    size_t capacity = memory->capacity < 4096 ? 4096 : memory->capacity;
+    while (memory->length + length > capacity) capacity *= 2;
+    memory->chars = realloc(memory->chars, capacity);
+    if (memory->chars == NULL) {
+      fprintf(stderr, "Ran out of memory keeping command output.\n");
+      exit(1);
+    }
+    memory->capacity = capacity;
+  }
+  memcpy(memory->chars + memory->length, chars, length);
+  memory->length += length;
+  memory->lines += countLines(chars, length);
+  memory->runs++;
+}
+
+Sink memorySink(MemorySink *memory) {
+  memory->chars = NULL;
+  memory->length = 0;
+  memory->capacity = 0;
+  memory->lines = 0;
+  memory->runs = 0;
+  return (Sink) {memoryRun, memory};
+}
+
+void clearMemorySink(MemorySink *memory) {
+  /* Keeps the allocation for the next run. */
+  memory->length = 0;
+  memory->lines = 0;
+  memory->runs = 0;
+}
+
+/* Spool sink */
+
+static void spoolRun(void *data, const AnsiStyle *style, const char *chars, size_t length, bool isError) {
+  spoolAppend(data, chars, length);
+}
+
+Sink spoolSink(Spool *spool) {
+  return (Sink) {spoolRun, spool};
+}
@@ -0,0 +1,48 @@
+#ifndef SGIDLS_SINK
+#define SGIDLS_SINK
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "ansi.h"
+#include "spool.h"
+#include "utf8.h"
+
+/* Where command output ends up once it is valid UTF-8 and split into runs of one style. Consoles have a sink
+   for each mode, and the ones below need no display, so the stages before them can be measured on their own. */
+typedef struct {
+  void (*run)(void *data, const AnsiStyle *style, const char *chars, size_t length, bool isError);
+  void *data;
+} Sink;
+
+/* The stages between a command's pipes and a sink. Stdout and stderr each keep their own state, since either
+   can leave a character or an escape sequence unfinished at the end of a chunk. */
+typedef struct {
+  Sink sink;
+  Utf8Repair outputUtf8;
+  Utf8Repair errorUtf8;
+  AnsiParser outputAnsi;
+  AnsiParser errorAnsi;
+} Pipeline;
+
+extern void initPipeline(Pipeline *pipeline, Sink sink);
+extern void resetPipeline(Pipeline *pipeline);
+extern void freePipeline(Pipeline *pipeline);
+extern void pipelineWrite(Pipeline *pipeline, const char *chars, size_t length, bool isError);
+extern void pipelineFlush(Pipeline *pipeline);
+
+/* Keeps the text and counts lines and runs, dropping the styles. */
+typedef struct {
+  char *chars;
+  size_t length;
+  size_t capacity;
+  size_t lines;
+  size_t runs;
+} MemorySink;
+
+extern Sink nullSink();
+extern Sink memorySink(MemorySink *memory);
+extern void clearMemorySink(MemorySink *memory);
+extern Sink spoolSink(Spool *spool);
+
+#endif
@@ -0,0 +1,383 @@
+#define _GNU_SOURCE /* MSG_CMSG_CLOEXEC */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <glib-unix.h>
+
+#include "spawn.h"
+
+void limitChild(int maxMemory, int maxCpu) {
+  /* Set before exec, so the limits hold for the shell and everything it starts. */
+  if (maxMemory > 0) {
+    rlim_t bytes = (rlim_t) maxMemory * 1024 * 1024;
+    struct rlimit limit = { bytes, bytes };
+    setrlimit(RLIMIT_AS, &limit);
+  }
+  if (maxCpu > 0) {
+    /* SIGXCPU at the soft limit, SIGKILL a second later if that's ignored. */
+    struct rlimit limit = { maxCpu, maxCpu + 1 };
+    setrlimit(RLIMIT_CPU, &limit);
+  }
+}
+
+void execShell(char *command, char **environment) {
+  /* The environment was built before forking, so there is nothing left to do but exec. */
+  if (environment != NULL) {
+    execle("/bin/sh", "sh", "-c", command, (char *) NULL, environment);
+  } else {
+    execl("/bin/sh", "sh", "-c", command, (char *) NULL);
+  }
+  _exit(127);
+}
+
+void becomeChild(char *command, char **environment, int fds[3], int maxMemory, int maxCpu) {
+  /* fds are what to put in place of stdin, stdout and stderr, -1 to leave one as it is. */
+  signal(SIGPIPE, SIG_DFL); /* Ignored signals stay ignored across exec. */
+  setpgid(0, 0); /* The child leads its own process group, so killing it takes anything it started along. */
+  limitChild(maxMemory, maxCpu);
+  for (int i = 0; i < 3; i++) {
+    if (fds[i] != -1) dup2(fds[i], i);
+  }
+  execShell(command, environment);
+}
+
+/* Spawn helper */
+
+typedef struct {
+  int fds; /* Which of stdin, stdout and stderr come attached, bit 0 for stdin. */
+  int maxMemory;
+  int maxCpu;
+  int environmentCount; /* -1 to keep the helper's own environment. */
+  size_t commandLength; /* Both lengths count the terminating NULs. */
+  size_t environmentLength;
+} SpawnRequest;
+
+typedef struct {
+  pid_t pid; /* -1 when the fork failed. */
+  int error;
+} SpawnReply;
+
+typedef struct {
+  pid_t pid;
+  int status;
+  struct rusage usage;
+} SpawnExit;
+
+typedef struct Spawned Spawned;
+struct Spawned {
+  pid_t pid;
+  SpawnExited exited;
+  void *data;
+  Spawned *next;
+};
+
+static int requests = -1; /* Our end of the socket requests go down, -1 when there's no helper. */
+static int exits = -1; /* And the one it tells us about exits on. One message per exit, so it's a seqpacket socket. */
+static Spawned *spawned = NULL; /* Children waiting to be told about. */
+static GString *payload = NULL;
+
+static bool readAll(int fd, void *buffer, size_t length) {
+  for (size_t done = 0; done < length; ) {
+    ssize_t result = read(fd, (char *) buffer + done, length - done);
+    if (result == -1 && errno == EINTR) continue;
+    if (result <= 0) return false;
+    done += result;
+  }
+  return true;
+}
+
+static bool writeAll(int fd, const void *buffer, size_t length) {
+  for (size_t done = 0; done < length; ) {
+    ssize_t result = write(fd, (const char *) buffer + done, length - done);
+    if (result == -1 && errno == EINTR) continue;
+    if (result <= 0) return false;
+    done += result;
+  }
+  return true;
+}
+
+/* The helper's side. None of this touches GLib, it was forked before anything was set up. */
+
+static sigset_t childMask; /* The signal mask commands start with, without the helper's SIGCHLD blocked. */
+
+static bool receiveRequest(int socket, SpawnRequest *request, int fds[3]) {
+  /* The descriptors ride along with the fixed part of the request. */
+  struct iovec part = { request, sizeof(SpawnRequest) };
+  union {
+    struct cmsghdr align;
+    char chars[CMSG_SPACE(sizeof(int) * 3)];
+  } control;
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &part;
+  message.msg_iovlen = 1;
+  message.msg_control = control.chars;
+  message.msg_controllen = sizeof(control.chars);
+
+  ssize_t got;
+  do {
+    got = recvmsg(socket, &message, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+  } while (got == -1 && errno == EINTR);
+
+  int received[3];
+  int count = 0;
+  for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header)) {
+    if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) continue;
+    count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(received, CMSG_DATA(header), sizeof(int) * count);
+  }
+  if (got != sizeof(SpawnRequest)) {
+    for (int i = 0; i < count; i++) close(received[i]);
+    return false;
+  }
+
+  int next = 0;
+  for (int i = 0; i < 3; i++) fds[i] = (request->fds & (1 << i)) && next < count ? received[next++] : -1;
+  return true;
+}
+
+static bool serveRequest(int socket) {
+  SpawnRequest request;
+  int fds[3];
+  if (!receiveRequest(socket, &request, fds)) return false;
+
+  char *chars = malloc(request.commandLength + request.environmentLength);
+  char **environment = request.environmentCount < 0 ? NULL : malloc(sizeof(char *) * (request.environmentCount + 1));
+  bool success = chars != NULL && (request.environmentCount < 0 || environment != NULL) &&
+    readAll(socket, chars, request.commandLength + request.environmentLength);
+
+  SpawnReply reply = { -1, ENOMEM };
+  if (success) {
+    char *variable = chars + request.commandLength;
+    for (int i = 0; i < request.environmentCount; i++) {
+      environment[i] = variable;
+      variable += strlen(variable) + 1;
+    }
+    if (environment != NULL) environment[request.environmentCount] = NULL;
+
+    reply.pid = fork();
+    if (reply.pid == 0) {
+      sigprocmask(SIG_SETMASK, &childMask, NULL);
+      becomeChild(chars, environment, fds, request.maxMemory, request.maxCpu);
+    }
+    reply.error = reply.pid == -1 ? errno : 0;
+    if (reply.pid != -1) setpgid(reply.pid, 0); /* Both sides set it, so it's in place before we answer. */
+  }
+
+  for (int i = 0; i < 3; i++) {
+    if (fds[i] != -1) close(fds[i]);
+  }
+  free(environment);
+  free(chars);
+  return success && writeAll(socket, &reply, sizeof(reply));
+}
+
+static void reapChildren(int socket) {
+  SpawnExit report;
+  while ((report.pid = wait4(-1, &report.status, WNOHANG, &report.usage)) > 0) {
+    send(socket, &report, sizeof(report), MSG_NOSIGNAL);
+  }
+}
+
+static void runHelper(int requestSocket, int exitSocket) {
+  /* Waits on requests and on children exiting at once. SIGCHLD comes through a signalfd,
+     so neither wait can be interrupted by the other. */
+  sigset_t blocked;
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &blocked, &childMask);
+  int children = signalfd(-1, &blocked, SFD_CLOEXEC);
+  if (children == -1) _exit(1);
+
+  struct pollfd polls[2] = { { requestSocket, POLLIN, 0 }, { children, POLLIN, 0 } };
+  for (;;) {
+    if (poll(polls, 2, -1) == -1) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    if (polls[1].revents & POLLIN) {
+      struct signalfd_siginfo info;
+      while (read(children, &info, sizeof(info)) == -1 && errno == EINTR);
+      reapChildren(exitSocket);
+    }
+    /* We closed our end or went away, the commands still running carry on without us. */
+    if ((polls[0].revents & (POLLIN | POLLHUP | POLLERR)) && !serveRequest(requestSocket)) break;
+  }
+  _exit(0);
+}
+
+/* Our side */
+
+static void helperLost() {
+  if (requests == -1) return;
+  fprintf(stderr, "The spawn helper went away, commands are started directly from now on.\n");
+  close(requests);
+  requests = -1;
+}
+
+static void childExited(pid_t pid, int status, struct rusage *usage) {
+  for (Spawned **link = &spawned; *link != NULL; link = &(*link)->next) {
+    Spawned *child = *link;
+    if (child->pid != pid) continue;
+    *link = child->next;
+    child->exited(child->data, status, usage);
+    free(child);
+    return;
+  }
+}
+
+static gboolean readExits(gint fd, GIOCondition condition, gpointer data) {
+  SpawnExit report;
+  ssize_t got;
+  while ((got = recv(fd, &report, sizeof(report), 0)) == sizeof(report)) childExited(report.pid, report.status, &report.usage);
+  if (got == -1 && (errno == EAGAIN || errno == EINTR)) return G_SOURCE_CONTINUE;
+
+  /* The helper is gone. Whatever it still had running can't be waited for, so those are taken as having
+     exited, the same as when something else reaps one of our children. */
+  helperLost();
+  close(fd);
+  exits = -1;
+  while (spawned != NULL) childExited(spawned->pid, 0, NULL);
+  return G_SOURCE_REMOVE;
+}
+
+static void helperExited(GPid pid, gint status, gpointer data) {
+  g_spawn_close_pid(pid);
+}
+
+bool startSpawnHelper() {
+  /* Called before GTK is loaded, while there's next to nothing to copy and only the one thread. */
+  int requestPair[2];
+  int exitPair[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, requestPair) == -1) {
+    fprintf(stderr, "Couldn't make a socket for the spawn helper.\n");
+    return false;
+  }
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, exitPair) == -1) {
+    fprintf(stderr, "Couldn't make a socket for the spawn helper.\n");
+    close(requestPair[0]);
+    close(requestPair[1]);
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    fprintf(stderr, "Failed to start the spawn helper.\n");
+    close(requestPair[0]);
+    close(requestPair[1]);
+    close(exitPair[0]);
+    close(exitPair[1]);
+    return false;
+  } else if (pid == 0) {
+    close(requestPair[0]);
+    close(exitPair[0]);
+    runHelper(requestPair[1], exitPair[1]);
+  }
+
+  close(requestPair[1]);
+  close(exitPair[1]);
+  requests = requestPair[0];
+  exits = exitPair[0];
+  fcntl(exits, F_SETFL, fcntl(exits, F_GETFL) | O_NONBLOCK);
+  g_unix_fd_add(exits, G_IO_IN | G_IO_HUP | G_IO_ERR, readExits, NULL);
+  g_child_watch_add(pid, helperExited, NULL);
+  payload = g_string_new(NULL);
+  return true;
+}
+
+void stopSpawnHelper() {
+  /* The helper exits once our end of the request socket is closed. */
+  if (requests == -1) return;
+  close(requests);
+  requests = -1;
+}
+
+pid_t helperSpawn(char *command, char **environment, int fds[3], int maxMemory, int maxCpu, bool *forkHere) {
+  /* Returns the child's pid, or -1 when there's no helper, it couldn't fork or it was lost. forkHere says whether
+     the command surely didn't start, so the caller can fork it itself. */
+  *forkHere = true;
+  if (requests == -1) return -1;
+
+  SpawnRequest request = { 0, maxMemory, maxCpu, -1, strlen(command) + 1, 0 };
+  g_string_truncate(payload, 0);
+  g_string_append_len(payload, command, request.commandLength);
+  if (environment != NULL) {
+    request.environmentCount = 0;
+    for (char **variable = environment; *variable != NULL; variable++) {
+      g_string_append_len(payload, *variable, strlen(*variable) + 1);
+      request.environmentCount++;
+    }
+    request.environmentLength = payload->len - request.commandLength;
+  }
+
+  int attached[3];
+  int count = 0;
+  for (int i = 0; i < 3; i++) {
+    if (fds[i] == -1) continue;
+    request.fds |= 1 << i;
+    attached[count++] = fds[i];
+  }
+
+  struct iovec part = { &request, sizeof(request) };
+  union {
+    struct cmsghdr align;
+    char chars[CMSG_SPACE(sizeof(int) * 3)];
+  } control;
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &part;
+  message.msg_iovlen = 1;
+  if (count > 0) {
+    message.msg_control = control.chars;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(header), attached, sizeof(int) * count);
+  }
+
+  ssize_t sent;
+  do {
+    sent = sendmsg(requests, &message, MSG_NOSIGNAL);
+  } while (sent == -1 && errno == EINTR);
+
+  if (sent != sizeof(request) || !writeAll(requests, payload->str, payload->len)) {
+    helperLost(); /* The helper only forks once it has the whole request. */
+    return -1;
+  }
+  SpawnReply reply;
+  if (!readAll(requests, &reply, sizeof(reply))) {
+    helperLost(); /* It may have forked first, running the command here too could run it twice. */
+    *forkHere = false;
+    return -1;
+  }
+  if (reply.pid == -1) errno = reply.error;
+  return reply.pid;
+}
+
+void watchSpawned(pid_t pid, SpawnExited exited, void *data) {
+  /* Exits are only read from the main loop, so a child can't be reported before this is called for it. */
+  Spawned *child = malloc(sizeof(Spawned));
+  if (child == NULL) {
+    fprintf(stderr, "Ran out of memory watching command.\n");
+    exit(1);
+  }
+  child->pid = pid;
+  child->exited = exited;
+  child->data = data;
+  child->next = spawned;
+  spawned = child;
+}
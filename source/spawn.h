@@ -0,0 +1,22 @@
+#ifndef SGIDLS_SPAWN
+#define SGIDLS_SPAWN
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/* Only ever called in a freshly forked child. */
+extern void limitChild(int maxMemory, int maxCpu);
+extern void execShell(char *command, char **environment);
+extern void becomeChild(char *command, char **environment, int fds[3], int maxMemory, int maxCpu);
+
+/* A small process forked before GTK is loaded, which forks commands on our behalf. Forking it is cheap and
+   safe however big the window and however many threads GTK has started. Opt in with startSpawnHelper(). */
+typedef void (*SpawnExited)(void *data, int status, struct rusage *usage);
+
+extern bool startSpawnHelper();
+extern void stopSpawnHelper();
+extern pid_t helperSpawn(char *command, char **environment, int fds[3], int maxMemory, int maxCpu, bool *forkHere);
+extern void watchSpawned(pid_t pid, SpawnExited exited, void *data);
+
+#endif
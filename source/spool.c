@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "config.h"
+#include "spool.h"
+
+static void pushIndex(Spool *spool, size_t offset) {
+  if (spool->indexCount == spool->indexCapacity) {
+    spool->indexCapacity = spool->indexCapacity < 64 ? 64 : spool->indexCapacity * 2;
+    spool->index = realloc(spool->index, sizeof(size_t) * spool->indexCapacity);
+    if (spool->index == NULL) {
+      fprintf(stderr, "Ran out of memory indexing console output.\n");
+      exit(1);
+    }
+  }
+  spool->index[spool->indexCount++] = offset;
+}
+
+void initSpool(Spool *spool) {
+  spool->memory = NULL;
+  spool->capacity = 0;
+  spool->fd = -1;
+  spool->spillFailed = false;
+  spool->map = NULL;
+  spool->mapped = 0;
+  spool->size = 0;
+  spool->lines = 0;
+  spool->tail = 0;
+  spool->cacheLine = 0;
+  spool->cacheOffset = 0;
+  spool->index = NULL;
+  spool->indexCount = 0;
+  spool->indexCapacity = 0;
+  pushIndex(spool, 0); /* Line 0 always starts at the beginning. */
+}
+
+void clearSpool(Spool *spool) {
+  if (spool->map != NULL) munmap(spool->map, spool->mapped);
+  if (spool->fd != -1) close(spool->fd); /* The file was unlinked on creation, so this frees the disk space. */
+  free(spool->memory);
+  free(spool->index);
+  initSpool(spool);
+}
+
+void freeSpool(Spool *spool) {
+  clearSpool(spool); /* Closes the file, which frees the disk space, and leaves a fresh index behind. */
+  free(spool->index);
+  free(spool);
+}
+
+static size_t writeAll(int fd, const char *chars, size_t length) {
+  size_t written = 0;
+  while (written < length) {
+    ssize_t result = write(fd, chars + written, length - written);
+    if (result == -1) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "Failed writing console output to spool file!\n");
+      break;
+    }
+    written += result;
+  }
+  return written;
+}
+
+static bool spillToFile(Spool *spool) {
+  char template[4096];
+  char *tmpdir = getenv("TMPDIR");
+  snprintf(template, sizeof(template), "%s/sgidls-spool-XXXXXX", tmpdir != NULL ? tmpdir : "/tmp");
+
+  int fd = mkstemp(template);
+  if (fd == -1) {
+    fprintf(stderr, "Could not create spool file, keeping console output in memory.\n");
+    return false;
+  }
+  unlink(template); /* Nobody else needs to see it, and it vanishes with us. */
+
+  if (writeAll(fd, spool->memory, spool->size) != spool->size) {
+    close(fd);
+    return false;
+  }
+
+  free(spool->memory);
+  spool->memory = NULL;
+  spool->capacity = 0;
+  spool->fd = fd;
+  return true;
+}
+
+static void indexLines(Spool *spool, const char *chars, size_t length, size_t base) {
+  const char *c = chars;
+  const char *end = chars + length;
+  const char *newline;
+  while ((newline = memchr(c, '\n', end - c)) != NULL) {
+    spool->lines++;
+    spool->tail = base + (newline + 1 - chars);
+    if (spool->lines % SPOOL_INDEX_STRIDE == 0) pushIndex(spool, base + (newline + 1 - chars));
+    c = newline + 1;
+  }
+}
+
+void spoolAppend(Spool *spool, const char *chars, size_t length) {
+  if (spool->fd == -1 && !spool->spillFailed && spool->size + length > SPOOL_MEMORY_LIMIT) spool->spillFailed = !spillToFile(spool);
+
+  if (spool->fd != -1) {
+    length = writeAll(spool->fd, chars, length);
+  } else {
+    if (spool->size + length > spool->capacity) {
+      size_t capacity = spool->capacity < 4096 ? 4096 : spool->capacity;
+      while (capacity < spool->size + length) capacity *= 2;
+      spool->memory = realloc(spool->memory, capacity);
+      if (spool->memory == NULL) {
+	fprintf(stderr, "Ran out of memory storing console output.\n");
+	exit(1);
+      }
+      spool->capacity = capacity;
+    }
+    memcpy(spool->memory + spool->size, chars, length);
+  }
+
+  indexLines(spool, chars, length, spool->size);
+  spool->size += length;
+}
+
+size_t spoolLineCount(Spool *spool) {
+  /* An unterminated last line still counts as a line. */
+  return spool->lines + (spool->size > spool->tail ? 1 : 0);
+}
+
+static const char *spoolData(Spool *spool) {
+  if (spool->fd == -1) return spool->memory;
+
+  if (spool->mapped < spool->size) {
+    /* Mapping the whole file only costs address space; the kernel pages in what actually gets read. The mapping
+       is twice the file, so growing output is remapped a handful of times rather than on every redraw. Writes
+       show through a shared mapping, and nothing past the end of the file is ever read. */
+    if (spool->map != NULL) munmap(spool->map, spool->mapped);
+    size_t length = spool->size * 2;
+    spool->map = mmap(NULL, length, PROT_READ, MAP_SHARED, spool->fd, 0);
+    if (spool->map == MAP_FAILED) {
+      fprintf(stderr, "Failed mapping spool file!\n");
+      spool->map = NULL;
+      spool->mapped = 0;
+      return NULL;
+    }
+    spool->mapped = length;
+  }
+  return spool->map;
+}
+
+const char *spoolLine(Spool *spool, size_t line, size_t *length) {
+  *length = 0;
+  const char *data = spoolData(spool);
+  if (data == NULL || line >= spoolLineCount(spool)) return NULL;
+
+  const char *end = data + spool->size;
+  size_t from = line - line % SPOOL_INDEX_STRIDE;
+  const char *c = data + spool->index[line / SPOOL_INDEX_STRIDE];
+  if (spool->cacheLine > from && spool->cacheLine <= line) {
+    from = spool->cacheLine;
+    c = data + spool->cacheOffset;
+  }
+  for (size_t i = line - from; i > 0; i--) {
+    c = memchr(c, '\n', end - c) + 1;
+  }
+
+  spool->cacheLine = line;
+  spool->cacheOffset = c - data;
+
+  const char *newline = memchr(c, '\n', end - c);
+  *length = (newline == NULL ? end : newline) - c;
+  return c;
+}
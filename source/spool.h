@@ -0,0 +1,37 @@
+#ifndef SGIDLS_SPOOL
+#define SGIDLS_SPOOL
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Append-only store for command output. Output is kept in memory until it passes
+   SPOOL_MEMORY_LIMIT, then moves to an unlinked temporary file that is read back through mmap. */
+typedef struct {
+  char *memory;
+  size_t capacity;
+
+  int fd; /* -1 while the output is still in memory. */
+  bool spillFailed; /* The file couldn't be made, so the output stays in memory instead of trying on every append. */
+  char *map;
+  size_t mapped; /* Length of the mapping, which runs past the end of the file so it isn't redone on every redraw. */
+
+  size_t size;
+  size_t lines; /* Newlines seen so far. */
+  size_t tail; /* Offset just past the last newline. */
+
+  size_t cacheLine; /* Last line looked up, so reading lines in order doesn't rescan from the index. */
+  size_t cacheOffset;
+
+  size_t *index; /* Offset of every SPOOL_INDEX_STRIDE-th line. */
+  size_t indexCount;
+  size_t indexCapacity;
+} Spool;
+
+extern void initSpool(Spool *spool);
+extern void clearSpool(Spool *spool);
+extern void freeSpool(Spool *spool);
+extern void spoolAppend(Spool *spool, const char *chars, size_t length);
+extern size_t spoolLineCount(Spool *spool);
+extern const char *spoolLine(Spool *spool, size_t line, size_t *length);
+
+#endif
@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <signal.h>
+#include <unistd.h>
+#include <glib-unix.h>
+
+#include "console.h"
+#include "job.h"
+#include "stats.h"
+#include "strings.h"
+#include "table.h"
+
+static long residentKilobytes() {
+  /* The second field of statm is the resident set, in pages. */
+  long size, resident;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm == NULL) return -1;
+  int fields = fscanf(statm, "%ld %ld", &size, &resident);
+  fclose(statm);
+  if (fields != 2) return -1;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void printMemoryStats(FILE *out) {
+  fprintf(out, "Memory statistics for process %d\n", (int) getpid());
+  long resident = residentKilobytes();
+  if (resident >= 0) fprintf(out, "  resident: %ld kB\n", resident);
+  printStringStats(out);
+  printPanelStats(out);
+  printConsoleStats(out);
+  printJobStats(out);
+  fflush(out);
+}
+
+static gboolean memoryStatsRequested(gpointer data) {
+  printMemoryStats(stderr);
+  return G_SOURCE_CONTINUE;
+}
+
+void watchMemoryStats() {
+  /* Delivered through the main loop, so the report never runs in the middle of a table update. */
+  g_unix_signal_add(SIGUSR2, memoryStatsRequested, NULL);
+}
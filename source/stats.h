@@ -0,0 +1,9 @@
+#ifndef SGIDLS_STATS
+#define SGIDLS_STATS
+
+#include <stdio.h>
+
+extern void printMemoryStats(FILE *out);
+extern void watchMemoryStats();
+
+#endif
@@ -10,22 +10,36 @@ typedef struct LinkedString LinkedString;
 
 struct LinkedString {
   char *chars;
+  Panel *panel; /* Saved strings go when the panel they were saved for is freed. */
+  bool expanded; /* An expanded command rather than a string from a description file. */
+  size_t bytes; /* What it counted for in the statistics, unescaping may have shortened it since. */
   LinkedString *next;
 }; /* Create a linked list of char * to ensure that all strings are remembered and properly disposed of on program exit. */
 
 LinkedString *root = NULL;
 
+/* Saved strings live as long as their panel, which is until exit unless it's resident. Tokens are plucked
+   once per file, while every click on a button with variables in its command saves another expansion. */
+static size_t pluckedCount = 0;
+static size_t pluckedBytes = 0;
+static size_t expandedCount = 0;
+static size_t expandedBytes = 0;
+
 static LinkedString *pluckString(char *source, int length) {
   LinkedString *string = malloc(sizeof(LinkedString));
   char *heapChars = malloc((length + 1) * sizeof(char));
   memcpy(heapChars, source, length);
   heapChars[length] = '\0';
   string->chars = heapChars;
+  string->panel = NULL;
+  string->expanded = false;
+  string->bytes = sizeof(LinkedString) + length + 1;
   string->next = NULL;
   return string;
 }
 
 static void saveString(LinkedString *string) {
+  string->panel = getPanel();
   string->next = root;
   root = string;
 }
@@ -33,6 +47,8 @@ static void saveString(LinkedString *string) {
 char *pluckToken(Token *token) {
   LinkedString *string = pluckString(token->start + 1, token->length - 2); /* Pluck the string, minus the quotation marks. */
   saveString(string);
+  pluckedCount++;
+  pluckedBytes += string->bytes;
   return string->chars;
 }
 
@@ -62,6 +78,9 @@ static LinkedString *collapseList(LinkedString *da_root) {
 
   LinkedString *collapsedString = malloc(sizeof(LinkedString));
   collapsedString->chars = malloc(sizeof(char) * totalLength + 1);
+  collapsedString->panel = NULL;
+  collapsedString->expanded = false;
+  collapsedString->bytes = sizeof(LinkedString) + totalLength + 1;
   collapsedString->next = NULL;
   char *c = collapsedString->chars;
   string = da_root;
@@ -166,13 +185,64 @@ char *parseCommand(char *command) {
     string->next = endString;
     LinkedString *finalString = collapseList(da_root);
     freeStringList(da_root);
+    finalString->expanded = true;
     saveString(finalString);
+    expandedCount++;
+    expandedBytes += finalString->bytes;
     return finalString->chars;
   } else {
     return command;
   }
 }
 
+char *unescapeString(char *chars) {
+  /* Collapses backslash escapes in place. Only used where a control character is genuinely
+     needed, such as table separators, since commands are handed to the shell verbatim. */
+  char *read = chars;
+  char *write = chars;
+  while (*read != '\0') {
+    if (*read == '\\' && read[1] != '\0') {
+      read++;
+      switch (*read) {
+      case 't': *write = '\t'; break;
+      case 'n': *write = '\n'; break;
+      default: *write = *read; break;
+      }
+    } else {
+      *write = *read;
+    }
+    read++;
+    write++;
+  }
+  *write = '\0';
+  return chars;
+}
+
 void freeStrings() {
   freeStringList(root);
 }
+
+void freePanelStrings(Panel *panel) {
+  LinkedString **link = &root;
+  while (*link != NULL) {
+    LinkedString *string = *link;
+    if (string->panel != panel) {
+      link = &string->next;
+      continue;
+    }
+    *link = string->next;
+    if (string->expanded) {
+      expandedCount--;
+      expandedBytes -= string->bytes;
+    } else {
+      pluckedCount--;
+      pluckedBytes -= string->bytes;
+    }
+    freeString(string);
+  }
+}
+
+void printStringStats(FILE *out) {
+  fprintf(out, "  strings: %zu from description files, %zu bytes\n", pluckedCount, pluckedBytes);
+  fprintf(out, "  strings: %zu expanded commands, %zu bytes\n", expandedCount, expandedBytes);
+}
@@ -1,10 +1,17 @@
 #ifndef SGIDLS_STRINGS
 #define SGIDLS_STRINGS
 
+#include <stdio.h>
+
 #include "scanner.h"
 
+typedef struct Panel Panel;
+
 extern char *pluckToken(Token *token);
 extern void freeStrings();
+extern void freePanelStrings(Panel *panel);
 extern char *parseCommand(char *command);
+extern char *unescapeString(char *chars);
+extern void printStringStats(FILE *out);
 
 #endif
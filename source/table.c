@@ -1,35 +1,80 @@
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <gtk/gtk.h>
 
 #include "config.h"
+#include "checklist.h"
 #include "common.h"
+#include "completion.h"
+#include "console.h"
+#include "job.h"
+#include "label.h"
+#include "progress.h"
+#include "strings.h"
 #include "table.h"
 
+extern char **environ;
+
 typedef struct {
   char *key;
   void *value;
   bool enabled;
+  bool owned; /* The value belongs to the table and is freed when replaced. */
 } Entry;
 
 typedef struct {
   int capacity;
   int count;
   Entry *entries;
+  unsigned version; /* Bumped whenever a value or enable flag changes, so anything derived from the table knows when it is stale. */
 } Table;
 
-Table variables;
-Table namedWidgets;
+typedef struct Watch Watch;
+
+struct Watch {
+  VariableWatcher changed;
+  void *data;
+  Watch *next;
+};
+
+struct Panel {
+  Table variables;
+  Table watches; /* Variable name to the list of everything that wants to hear when it changes. */
+  Table namedWidgets;
+  Table actions; /* Commands of named buttons, so they can be run without clicking. */
+  Table consoles;
+  Console *defaultConsole; /* The first console declared receives output from buttons that don't name one. */
+
+  bool exportVariables; /* Commands get the variables in their environment as SGIDL_name. */
+  char **environment; /* Built from the variables when they were at environmentVersion, NULL until first needed. */
+  unsigned environmentVersion;
+  bool closed; /* Its window is gone, along with every widget and console in it. */
+  int holds; /* Jobs, saves and the like still under way, which may yet touch its consoles and commands. */
+  guint release; /* Pending idle that frees what a closed panel left behind, 0 when there is none. */
+  Panel *next; /* Every panel ever opened, for memory statistics. */
+};
+
+/* Every window gets its own panel. Signal handlers switch to the panel their widget belongs to
+   before touching any of the tables, so two panels in one process never see each other's names. */
+static Panel firstPanel;
+static Panel *current = &firstPanel;
+static Panel *panels = &firstPanel;
 
 static void initTable(Table *table) {
   table->capacity = 0;
   table->count = 0;
   table->entries = NULL;
+  table->version = 0;
 }
 
 static void freeTable(Table *table) {
+  for (int i = 0; i < table->capacity; i++) {
+    if (table->entries[i].key != NULL && table->entries[i].owned) free(table->entries[i].value);
+  }
   free(table->entries);
   initTable(table);
 }
@@ -65,6 +110,7 @@ static void adjustCapacity(Table *table, int capacity) {
     entries[i].key = NULL;
     entries[i].value = NULL;
     entries[i].enabled = false;
+    entries[i].owned = false;
   }
 
   int count = 0;
@@ -76,6 +122,8 @@ static void adjustCapacity(Table *table, int capacity) {
     count++;
     dest->key = entry->key;
     dest->value = entry->value;
+    dest->enabled = entry->enabled;
+    dest->owned = entry->owned;
   }
 
   free(table->entries);
@@ -84,7 +132,7 @@ static void adjustCapacity(Table *table, int capacity) {
   table->capacity = capacity;
 }
  
-static bool tableSet(Table *table, const char *key, void *value) {
+static bool tablePut(Table *table, const char *key, void *value, bool owned) {
   if (table->count + 1 > table->capacity * TABLE_MAX_LOAD_FACTOR) {
     int capacity = (table->capacity < 8 ? 8 : (table->capacity * 2));
     adjustCapacity(table, capacity);
@@ -93,13 +141,20 @@ static bool tableSet(Table *table, const char *key, void *value) {
   Entry *entry = findEntry(table->entries, table->capacity, key);
   bool isNewKey = entry->key == NULL;
   if (isNewKey) table->count++;
+  if (!isNewKey && entry->owned) free(entry->value);
 
   entry->key = key;
   entry->value = value;
   entry->enabled = true;
+  entry->owned = owned;
+  table->version++;
   return isNewKey;
 }
 
+static bool tableSet(Table *table, const char *key, void *value) {
+  return tablePut(table, key, value, false);
+}
+
 static bool tableGet(Table *table, const char *key, void **value) {
   if (table->count == 0) return false;
 
@@ -129,6 +184,7 @@ static bool tableEnable(Table *table, const char *key, bool shouldEnable) {
   Entry *entry = findEntry(table->entries, table->capacity, key);
   if (entry->key == NULL) return false;
 
+  if (entry->enabled != shouldEnable) table->version++;
   entry->enabled = shouldEnable;
   return true;
 }
@@ -143,6 +199,28 @@ static bool tableGetEnable(Table *table, const char *key, bool *enable) {
   return true;
 }
 
+static void printTableStats(FILE *out, char *name, Table *table) {
+  /* Nothing is ever deleted from these tables, so every slot counted holds a live entry. */
+  fprintf(out, "    %s: %d of %d slots used, load %.2f, %zu bytes\n", name, table->count, table->capacity,
+          table->capacity == 0 ? 0.0 : (double) table->count / table->capacity, sizeof(Entry) * table->capacity);
+}
+
+void printPanelStats(FILE *out) {
+  int number = 0;
+  for (Panel *panel = panels; panel != NULL; panel = panel->next, number++) {
+    if (panel->closed) continue;
+    if (panel->variables.capacity == 0 && panel->watches.capacity == 0 &&
+        panel->namedWidgets.capacity == 0 && panel->actions.capacity == 0 && panel->consoles.capacity == 0) continue;
+
+    fprintf(out, "  panel %d\n", number);
+    printTableStats(out, "variables", &panel->variables);
+    printTableStats(out, "watches", &panel->watches);
+    printTableStats(out, "widgets", &panel->namedWidgets);
+    printTableStats(out, "actions", &panel->actions);
+    printTableStats(out, "consoles", &panel->consoles);
+  }
+}
+
 static void printTable(Table *table) {
   printf("{ ");
   int entryCount = 0;
@@ -162,13 +240,13 @@ static void printTable(Table *table) {
 }
 
 void printVariables() {
-  printTable(&variables);
+  printTable(&current->variables);
   printf("\n");
 }
 
 char *getVariable(const char *key) {
   void *result = NULL;
-  bool success = tableGet(&variables, key, &result);
+  bool success = tableGet(&current->variables, key, &result);
   if (success) {
     return (char *)result;
   } else {
@@ -177,26 +255,111 @@ char *getVariable(const char *key) {
 }
 
 bool teachVariable(const char *key) {
-  return tableSet(&variables, key, NULL);
+  return tableSet(&current->variables, key, NULL);
+}
+
+static void notifyWatches(const char *key) {
+  void *head = NULL;
+  if (!tableGet(&current->watches, key, &head)) return;
+  for (Watch *watch = head; watch != NULL; watch = watch->next) {
+    watch->changed(watch->data);
+  }
+}
+
+void watchVariable(const char *key, VariableWatcher changed, void *data) {
+  Watch *watch = allocate(sizeof(Watch), "Ran out of memory watching variable.");
+  watch->changed = changed;
+  watch->data = data;
+  watch->next = NULL;
+
+  void *head = NULL;
+  tableGet(&current->watches, key, &head);
+  watch->next = head;
+  tableSet(&current->watches, key, watch);
 }
 
 bool setVariable(const char *key, char *value) {
-  return tableSet(&variables, key, (void *) value);
+  bool result = tableSet(&current->variables, key, (void *) value);
+  notifyWatches(key);
+  return result;
+}
+
+bool takeVariable(const char *key, char *value) {
+  /* Like setVariable, but the table takes over the value and frees it once it is replaced. */
+  bool result = tablePut(&current->variables, key, (void *) value, true);
+  notifyWatches(key);
+  return result;
+}
+
+static void freeEnvironment(Panel *panel) {
+  if (panel->environment == NULL) return;
+  for (char **variable = panel->environment; *variable != NULL; variable++) free(*variable);
+  free(panel->environment);
+  panel->environment = NULL;
+}
+
+void exportVariables(bool shouldExport) {
+  current->exportVariables = shouldExport;
+}
+
+static char *exportedVariable(const char *key, const char *value) {
+  /* Characters a shell won't take in a name, like the dashes in "file-name", become underscores. */
+  size_t keyLength = strlen(key);
+  size_t valueLength = strlen(value);
+  char *variable = allocate(sizeof("SGIDL_") + keyLength + 1 + valueLength, "Ran out of memory exporting variables.");
+  char *c = stpcpy(variable, "SGIDL_");
+  for (size_t i = 0; i < keyLength; i++) {
+    char k = key[i];
+    *c++ = ((k >= 'a' && k <= 'z') || (k >= 'A' && k <= 'Z') || (k >= '0' && k <= '9')) ? k : '_';
+  }
+  *c++ = '=';
+  memcpy(c, value, valueLength + 1);
+  return variable;
+}
+
+char **variableEnvironment() {
+  /* Rebuilt only when a variable has changed since the last command, so most commands start with the environment as it is. */
+  if (!current->exportVariables) return NULL;
+  if (current->environment != NULL && current->environmentVersion == current->variables.version) return current->environment;
+  freeEnvironment(current);
+
+  int inherited = 0;
+  while (environ[inherited] != NULL) inherited++;
+  char **environment = allocate(sizeof(char *) * (inherited + current->variables.count + 1), "Ran out of memory exporting variables.");
+
+  /* Our own SGIDL_ variables are left out, so a disabled variable is unset rather than inherited. */
+  int count = 0;
+  for (int i = 0; i < inherited; i++) {
+    if (strncmp(environ[i], "SGIDL_", 6) == 0) continue;
+    environment[count++] = strdup(environ[i]);
+  }
+  for (int i = 0; i < current->variables.capacity; i++) {
+    Entry *entry = &current->variables.entries[i];
+    if (entry->key == NULL || !entry->enabled || entry->value == NULL) continue;
+    environment[count++] = exportedVariable(entry->key, entry->value);
+  }
+  environment[count] = NULL;
+
+  current->environment = environment;
+  current->environmentVersion = current->variables.version;
+  return environment;
 }
 
 bool enableVariable(const char *key, bool shouldEnable) {
-  return tableEnable(&variables, key, shouldEnable);
+  bool success = tableEnable(&current->variables, key, shouldEnable);
+  if (success) notifyWatches(key);
+  return success;
 }
 
 bool getEnableVariable(const char *key) {
   bool isEnabled = false;
-  if (tableGetEnable(&variables, key, &isEnabled)) return isEnabled;
+  if (tableGetEnable(&current->variables, key, &isEnabled)) return isEnabled;
   return false;
 }
 
 GtkWidget *getWidget(const char *name) {
   void *result = NULL;
-  bool success = tableGet(&namedWidgets, name, &result);
+  bool success = tableGet(&current->namedWidgets, name, &result);
   if (success) {
     return (GtkWidget *)result;
   } else {
@@ -205,11 +368,11 @@ GtkWidget *getWidget(const char *name) {
 }
 
 bool teachWidget(const char *name) {
-  return tableSet(&namedWidgets, name, NULL);
+  return tableSet(&current->namedWidgets, name, NULL);
 }
 
 bool setWidget(const char *name, GtkWidget *widget) {
-  return tableSet(&namedWidgets, name, (void *) widget);
+  return tableSet(&current->namedWidgets, name, (void *) widget);
 }
 
 bool setSensitiveWidget(const char *name, bool sensitivity) {
@@ -218,3 +381,124 @@ bool setSensitiveWidget(const char *name, bool sensitivity) {
   gtk_widget_set_sensitive(widget, sensitivity);
   return true;
 }
+
+Command *getAction(const char *name) {
+  void *result = NULL;
+  bool success = tableGet(&current->actions, name, &result);
+  return success ? result : NULL;
+}
+
+bool setAction(const char *name, Command *command) {
+  return tableSet(&current->actions, name, command);
+}
+
+Console *getConsole(const char *name) {
+  void *result = NULL;
+  bool success = tableGet(&current->consoles, name, &result);
+  if (success) {
+    return (Console *)result;
+  } else {
+    return NULL;
+  }
+}
+
+bool setConsole(const char *name, Console *console) {
+  return tableSet(&current->consoles, name, (void *) console);
+}
+
+Console *getDefaultConsole() {
+  return current->defaultConsole;
+}
+
+void setDefaultConsole(Console *console) {
+  current->defaultConsole = console;
+}
+
+Panel *newPanel() {
+  Panel *panel = allocate(sizeof(Panel), "Ran out of memory creating panel.");
+  initTable(&panel->variables);
+  initTable(&panel->watches);
+  initTable(&panel->namedWidgets);
+  initTable(&panel->actions);
+  initTable(&panel->consoles);
+  panel->defaultConsole = NULL;
+  panel->exportVariables = false;
+  panel->environment = NULL;
+  panel->environmentVersion = 0;
+  panel->closed = false;
+  panel->holds = 0;
+  panel->release = 0;
+  panel->next = panels;
+  panels = panel;
+  return panel;
+}
+
+void usePanel(Panel *panel) {
+  current = panel;
+}
+
+Panel *getPanel() {
+  return current;
+}
+
+static gboolean freeClosedPanel(gpointer data) {
+  /* From an idle, so the window has finished destroying the widgets whose handlers point at the consoles. */
+  Panel *panel = data;
+  panel->release = 0;
+  if (panel->holds > 0) return G_SOURCE_REMOVE;
+  freePanelLabels(panel);
+  freePanelCompletions(panel);
+  freePanelChecklists(panel);
+  freePanelProgress(panel);
+  freePanelConsoles(panel);
+  freePanelCommands(panel);
+  freePanelStrings(panel);
+  return G_SOURCE_REMOVE;
+}
+
+static void scheduleRelease(Panel *panel) {
+  if (panel->closed && panel->holds == 0 && panel->release == 0) panel->release = g_idle_add(freeClosedPanel, panel);
+}
+
+void closePanel(Panel *panel) {
+  /* The struct itself stays around, since a command started from the panel may still finish after its window is gone.
+     Its consoles, commands and strings go once nothing under way still holds the panel. */
+  for (int i = 0; i < panel->watches.capacity; i++) {
+    Watch *watch = panel->watches.entries[i].value;
+    while (watch != NULL) {
+      Watch *next = watch->next;
+      free(watch);
+      watch = next;
+    }
+  }
+  freeTable(&panel->variables);
+  freeTable(&panel->watches);
+  freeTable(&panel->namedWidgets);
+  freeTable(&panel->actions);
+  freeTable(&panel->consoles);
+  panel->defaultConsole = NULL;
+  freeEnvironment(panel);
+  panel->closed = true;
+  scheduleRelease(panel);
+}
+
+bool panelClosed(Panel *panel) {
+  return panel->closed;
+}
+
+void holdPanel(Panel *panel) {
+  panel->holds++;
+}
+
+void releasePanel(Panel *panel) {
+  panel->holds--;
+  scheduleRelease(panel);
+}
+
+Binding *newBinding(char *key) {
+  Binding *binding = allocate(sizeof(Binding), "Ran out of memory binding widget.");
+  binding->panel = current;
+  binding->key = key;
+  binding->line = -1;
+  return binding;
+}
@@ -2,17 +2,54 @@
 #define SGIDLS_TABLE
 
 #include <gtk/gtk.h>
+#include <stdio.h>
 #include <stdbool.h>
 
+#include "console.h"
+
+typedef struct Panel Panel;
+typedef struct Command Command;
+
+typedef struct {
+  Panel *panel;
+  char *key; /* Name of the variable or widget a signal handler acts on. */
+  int line; /* Line the cursor was last on, for a console's variable. -1 before it has been anywhere. */
+} Binding;
+
+extern Panel *newPanel();
+extern void usePanel(Panel *panel);
+extern Panel *getPanel();
+extern void closePanel(Panel *panel);
+extern bool panelClosed(Panel *panel);
+/* Anything that outlives a click and may touch the panel's consoles or commands holds it until it is done. */
+extern void holdPanel(Panel *panel);
+extern void releasePanel(Panel *panel);
+extern Binding *newBinding(char *key);
+extern void printPanelStats(FILE *out);
+
+typedef void (*VariableWatcher)(void *data);
+
 extern void printVariables();
 extern char *getVariable(const char *key);
 extern bool teachVariable(const char *key);
 extern bool setVariable(const char *key, char *value);
+extern bool takeVariable(const char *key, char *value);
 extern bool enableVariable(const char *key, bool shouldEnable);
 extern bool getEnableVariable(const char *key);
+extern void watchVariable(const char *key, VariableWatcher changed, void *data);
+extern void exportVariables(bool shouldExport);
+extern char **variableEnvironment();
 
 extern GtkWidget *getWidget(const char *name);
 extern bool teachWidget(const char *name);
 extern bool setWidget(const char *name, GtkWidget *widget);
 extern bool setSensitiveWidget(const char *name, bool sensitivity);
+
+extern Command *getAction(const char *name);
+extern bool setAction(const char *name, Command *command);
+
+extern Console *getConsole(const char *name);
+extern bool setConsole(const char *name, Console *console);
+extern Console *getDefaultConsole();
+extern void setDefaultConsole(Console *console);
 #endif
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "utf8.h"
+
+typedef enum {
+  SEQUENCE_COMPLETE, /* A whole, valid character. */
+  SEQUENCE_CUT, /* A valid start that runs into the end of the input. */
+  SEQUENCE_INVALID /* Bytes that can't be part of any character. */
+} SequenceState;
+
+void initUtf8(Utf8Repair *repair) {
+  repair->pendingLength = 0;
+  repair->buffer = NULL;
+  repair->capacity = 0;
+}
+
+void resetUtf8(Utf8Repair *repair) {
+  repair->pendingLength = 0;
+}
+
+void freeUtf8(Utf8Repair *repair) {
+  free(repair->buffer);
+  initUtf8(repair);
+}
+
+static size_t asciiRun(const unsigned char *chars, size_t length) {
+  /* Eight bytes at a time while none of them has its high bit set or is zero, which is all that plain text ever is. */
+  const uint64_t ones = 0x0101010101010101ULL;
+  const uint64_t highs = 0x8080808080808080ULL;
+  size_t i = 0;
+  while (i + 8 <= length) {
+    uint64_t word;
+    memcpy(&word, chars + i, 8);
+    if ((word & highs) != 0 || ((word - ones) & ~word & highs) != 0) break;
+    i += 8;
+  }
+  while (i < length && chars[i] != 0 && chars[i] < 0x80) i++;
+  return i;
+}
+
+static SequenceState checkSequence(const unsigned char *chars, size_t length, size_t *sequenceLength) {
+  /* Follows the Unicode advice on replacement: an invalid sequence is as many bytes as could still have been
+     the start of a character, or the one byte when not even that. */
+  unsigned char first = chars[0];
+  size_t need;
+  unsigned char low = 0x80, high = 0xBF; /* What the second byte may be. */
+  if (first >= 0xC2 && first <= 0xDF) {
+    need = 2;
+  } else if (first >= 0xE0 && first <= 0xEF) {
+    need = 3;
+    if (first == 0xE0) low = 0xA0; /* Overlong */
+    if (first == 0xED) high = 0x9F; /* Surrogates */
+  } else if (first >= 0xF0 && first <= 0xF4) {
+    need = 4;
+    if (first == 0xF0) low = 0x90; /* Overlong */
+    if (first == 0xF4) high = 0x8F; /* Past U+10FFFF */
+  } else {
+    *sequenceLength = 1;
+    return SEQUENCE_INVALID;
+  }
+
+  size_t valid = 1;
+  while (valid < need && valid < length) {
+    unsigned char next = chars[valid];
+    if (valid == 1 ? next < low || next > high : (next & 0xC0) != 0x80) break;
+    valid++;
+  }
+
+  *sequenceLength = valid;
+  if (valid == need) return SEQUENCE_COMPLETE;
+  if (valid == length) return SEQUENCE_CUT;
+  return SEQUENCE_INVALID;
+}
+
+static void append(Utf8Repair *repair, size_t *used, const void *chars, size_t length) {
+  if (*used + length > repair->capacity) {
+    size_t capacity = repair->capacity < 256 ? 256 : repair->capacity;
+    while (*used + length > capacity) capacity *= 2;
+    repair->buffer = realloc(repair->buffer, capacity);
+    if (repair->buffer == NULL) {
+      fprintf(stderr, "Ran out of memory repairing command output.\n");
+      exit(1);
+    }
+    repair->capacity = capacity;
+  }
+  memcpy(repair->buffer + *used, chars, length);
+  *used += length;
+}
+
+static size_t finishPending(Utf8Repair *repair, const unsigned char *chars, size_t length, size_t *used) {
+  /* Completes the character held back from the last chunk with the first bytes of this one.
+     Returns how many bytes of this chunk that took. */
+  unsigned char joined[4];
+  size_t borrowed = 4 - repair->pendingLength < length ? 4 - repair->pendingLength : length;
+  memcpy(joined, repair->pending, repair->pendingLength);
+  memcpy(joined + repair->pendingLength, chars, borrowed);
+
+  size_t sequenceLength;
+  switch (checkSequence(joined, repair->pendingLength + borrowed, &sequenceLength)) {
+  case SEQUENCE_COMPLETE:
+    append(repair, used, joined, sequenceLength);
+    break;
+  case SEQUENCE_CUT:
+    /* Still not enough of it, the chunk was tiny. */
+    memcpy(repair->pending, joined, sequenceLength);
+    repair->pendingLength = sequenceLength;
+    return length;
+  case SEQUENCE_INVALID:
+    append(repair, used, UTF8_REPLACEMENT, 3);
+    break;
+  }
+
+  /* The held back bytes were a valid start, so whatever ended the sequence came from this chunk. */
+  size_t taken = sequenceLength - repair->pendingLength;
+  repair->pendingLength = 0;
+  return taken;
+}
+
+const char *utf8Repair(Utf8Repair *repair, const char *chars, size_t length, size_t *repairedLength) {
+  /* Valid chunks are handed back as they are. Only a chunk with something to fix is copied into the buffer. */
+  const unsigned char *bytes = (const unsigned char *) chars;
+  size_t used = 0;
+  bool copying = repair->pendingLength > 0;
+  size_t i = copying ? finishPending(repair, bytes, length, &used) : 0;
+  size_t runStart = i;
+  size_t end = length;
+
+  while (i < length) {
+    i += asciiRun(bytes + i, length - i);
+    if (i == length) break;
+
+    size_t sequenceLength = 1;
+    SequenceState state = bytes[i] == 0 ? SEQUENCE_INVALID : checkSequence(bytes + i, length - i, &sequenceLength);
+    if (state == SEQUENCE_COMPLETE) {
+      i += sequenceLength;
+    } else if (state == SEQUENCE_CUT) {
+      memcpy(repair->pending, bytes + i, sequenceLength);
+      repair->pendingLength = sequenceLength;
+      end = i;
+      break;
+    } else {
+      copying = true;
+      append(repair, &used, bytes + runStart, i - runStart);
+      append(repair, &used, UTF8_REPLACEMENT, 3);
+      i += sequenceLength;
+      runStart = i;
+    }
+  }
+
+  if (copying) append(repair, &used, bytes + runStart, end - runStart);
+  if (!copying || used == 0) {
+    *repairedLength = copying ? 0 : end;
+    return chars;
+  }
+  *repairedLength = used;
+  return repair->buffer;
+}
+
+const char *utf8Flush(Utf8Repair *repair, size_t *repairedLength) {
+  /* The stream ended partway through a character. Returns NULL when it didn't. */
+  if (repair->pendingLength == 0) return NULL;
+  repair->pendingLength = 0;
+  *repairedLength = 3;
+  return UTF8_REPLACEMENT;
+}
@@ -0,0 +1,24 @@
+#ifndef SGIDLS_UTF8
+#define SGIDLS_UTF8
+
+#include <stddef.h>
+
+#define UTF8_REPLACEMENT "\xEF\xBF\xBD" /* U+FFFD, stands in for bytes that aren't UTF-8. */
+
+/* Turns a stream of arbitrary bytes into valid UTF-8, chunk by chunk. A character cut in half at the end of
+   one chunk is held back until the next one completes it. Each invalid sequence becomes one U+FFFD, and so
+   does a NUL byte, which GTK won't take either. */
+typedef struct {
+  unsigned char pending[4]; /* Start of a character cut off at the end of the last chunk. */
+  size_t pendingLength;
+  char *buffer; /* Repaired chunks are written here. Valid ones never need it. */
+  size_t capacity;
+} Utf8Repair;
+
+extern void initUtf8(Utf8Repair *repair);
+extern void resetUtf8(Utf8Repair *repair);
+extern void freeUtf8(Utf8Repair *repair);
+extern const char *utf8Repair(Utf8Repair *repair, const char *chars, size_t length, size_t *repairedLength);
+extern const char *utf8Flush(Utf8Repair *repair, size_t *repairedLength);
+
+#endif
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sysexits.h>
+
+#include "common.h"
+#include "console.h"
+#include "job.h"
+#include "table.h"
+#include "workflow.h"
+
+typedef enum {
+  STEP_BLOCKED, /* Some of its prerequisites haven't succeeded yet. */
+  STEP_READY, /* Waiting its turn to be launched. */
+  STEP_RUNNING,
+  STEP_SUCCEEDED,
+  STEP_FAILED,
+  STEP_SKIPPED /* Something it comes after failed, so it never ran. */
+} StepState;
+
+typedef struct {
+  Workflow *workflow;
+  Command *command;
+  const char *name; /* The name it was reached by, NULL for the button that started the workflow. */
+  StepState state;
+  bool visiting; /* Still collecting its prerequisites, meeting it again means a cycle. */
+  int *prerequisites; /* Indices of the steps named in its 'after'. */
+  int blockers; /* Prerequisites that haven't succeeded yet. */
+  int *dependents; /* Indices of the steps that come after this one. */
+  int dependentCount;
+  JobWatcher watcher;
+} Step;
+
+struct Workflow {
+  Command *root;
+  Step *steps; /* Never moves once the workflow is built, the job watchers point into it. */
+  int count;
+  int capacity;
+  int unfinished; /* Steps that haven't succeeded, failed or been skipped yet. */
+  int *ready; /* Steps to launch, oldest first. A step is only ever added once, so count is room enough. */
+  int readyStart;
+  int readyEnd;
+  bool advancing;
+  bool cancelled; /* Restarted, nothing more is launched. */
+};
+
+static void freeWorkflow(Workflow *workflow) {
+  for (int i = 0; i < workflow->count; i++) {
+    free(workflow->steps[i].prerequisites);
+    free(workflow->steps[i].dependents);
+  }
+  free(workflow->steps);
+  free(workflow->ready);
+  free(workflow);
+}
+
+/* Building */
+
+static int addStep(Workflow *workflow, Command *command, const char *name) {
+  /* Collects the command and everything it comes after, depth first. Returns its index, or -1 on a missing
+     name or a cycle. */
+  for (int i = 0; i < workflow->count; i++) {
+    if (workflow->steps[i].command != command) continue;
+    if (!workflow->steps[i].visiting) return i;
+    fprintf(stderr, "'%s' ends up coming after itself!\n", name);
+    return -1;
+  }
+
+  if (workflow->count == workflow->capacity) {
+    workflow->capacity = workflow->capacity == 0 ? 8 : workflow->capacity * 2;
+    workflow->steps = realloc(workflow->steps, sizeof(Step) * workflow->capacity);
+    if (workflow->steps == NULL) {
+      fprintf(stderr, "Ran out of memory building workflow.\n");
+      exit(1);
+    }
+  }
+  int index = workflow->count++;
+  Step *step = &workflow->steps[index];
+  step->workflow = workflow;
+  step->command = command;
+  step->name = name;
+  step->state = STEP_BLOCKED;
+  step->visiting = true;
+  step->prerequisites = command->afterCount == 0 ? NULL :
+    allocate(sizeof(int) * command->afterCount, "Ran out of memory building workflow.");
+  step->blockers = command->afterCount;
+  step->dependents = NULL;
+  step->dependentCount = 0;
+
+  for (int i = 0; i < command->afterCount; i++) {
+    const char *after = command->after[i];
+    Command *prerequisite = getAction(after);
+    if (prerequisite == NULL) {
+      fprintf(stderr, "No button named '%s' runs a command, so nothing can come after it!\n", after);
+      return -1;
+    }
+    int found = addStep(workflow, prerequisite, after);
+    if (found == -1) return -1;
+    workflow->steps[index].prerequisites[i] = found; /* The recursion may have moved the steps. */
+  }
+  workflow->steps[index].visiting = false;
+  return index;
+}
+
+static Workflow *buildWorkflow(Command *command) {
+  Workflow *workflow = allocate(sizeof(Workflow), "Ran out of memory building workflow.");
+  workflow->root = command;
+  workflow->steps = NULL;
+  workflow->count = 0;
+  workflow->capacity = 0;
+  workflow->ready = NULL;
+  workflow->readyStart = 0;
+  workflow->readyEnd = 0;
+  workflow->advancing = false;
+  workflow->cancelled = false;
+
+  usePanel(command->panel); /* Names are looked up among the panel's buttons when it runs, so they can come in any order. */
+  if (addStep(workflow, command, NULL) == -1) {
+    freeWorkflow(workflow);
+    return NULL;
+  }
+
+  /* Turn the prerequisites around, finishing a step is when its dependents need looking at. */
+  for (int i = 0; i < workflow->count; i++) {
+    Step *step = &workflow->steps[i];
+    for (int j = 0; j < step->command->afterCount; j++) workflow->steps[step->prerequisites[j]].dependentCount++;
+  }
+  for (int i = 0; i < workflow->count; i++) {
+    Step *step = &workflow->steps[i];
+    step->dependents = step->dependentCount == 0 ? NULL :
+      allocate(sizeof(int) * step->dependentCount, "Ran out of memory building workflow.");
+    step->dependentCount = 0;
+  }
+  for (int i = 0; i < workflow->count; i++) {
+    Step *step = &workflow->steps[i];
+    for (int j = 0; j < step->command->afterCount; j++) {
+      Step *prerequisite = &workflow->steps[step->prerequisites[j]];
+      prerequisite->dependents[prerequisite->dependentCount++] = i;
+    }
+  }
+
+  workflow->unfinished = workflow->count;
+  workflow->ready = allocate(sizeof(int) * workflow->count, "Ran out of memory building workflow.");
+  for (int i = 0; i < workflow->count; i++) {
+    if (workflow->steps[i].blockers == 0) {
+      workflow->steps[i].state = STEP_READY;
+      workflow->ready[workflow->readyEnd++] = i;
+    }
+  }
+  return workflow;
+}
+
+/* Running */
+
+static void advance(Workflow *workflow);
+
+static void reportSkipped(Workflow *workflow, Step *step, const char *failed) {
+  /* Said where the step's own output would have gone, so the gap in it is explained. */
+  if (workflow->cancelled || panelClosed(workflow->root->panel)) return;
+  char report[256];
+  int length = step->name == NULL ? snprintf(report, sizeof(report), "[skipped, '%s' failed]\n", failed) :
+    snprintf(report, sizeof(report), "['%s' skipped, '%s' failed]\n", step->name, failed);
+  if (length >= (int) sizeof(report)) length = sizeof(report) - 1;
+
+  Command *command = step->command;
+  bool hidden = command->command == NULL || command->reader != NULL || (command->output != NULL && command->console == NULL);
+  usePanel(workflow->root->panel);
+  Console *console = hidden ? NULL : findConsole(command->errors != NULL ? command->errors : command->console);
+  if (console != NULL) {
+    consoleWriteError(console, report, length);
+    consoleFlush(console);
+  } else {
+    fputs(report, stderr);
+  }
+}
+
+static void skipStep(Workflow *workflow, int index, const char *failed) {
+  Step *step = &workflow->steps[index];
+  step->state = STEP_SKIPPED;
+  workflow->unfinished--;
+  reportSkipped(workflow, step, failed);
+  for (int i = 0; i < step->dependentCount; i++) {
+    if (workflow->steps[step->dependents[i]].state == STEP_BLOCKED) skipStep(workflow, step->dependents[i], failed);
+  }
+}
+
+static void settleStep(Workflow *workflow, int index, bool success) {
+  Step *step = &workflow->steps[index];
+  step->state = success ? STEP_SUCCEEDED : STEP_FAILED;
+  workflow->unfinished--;
+  for (int i = 0; i < step->dependentCount; i++) {
+    int dependent = step->dependents[i];
+    if (workflow->steps[dependent].state != STEP_BLOCKED) continue; /* Already skipped for another failure. */
+    if (!success) {
+      skipStep(workflow, dependent, step->name);
+    } else if (--workflow->steps[dependent].blockers == 0) {
+      workflow->steps[dependent].state = STEP_READY;
+      workflow->ready[workflow->readyEnd++] = dependent;
+    }
+  }
+}
+
+static void stepFinished(void *data, bool success) {
+  Step *step = data;
+  Workflow *workflow = step->workflow;
+  settleStep(workflow, step - workflow->steps, success);
+  advance(workflow);
+}
+
+static void launchStep(Workflow *workflow, int index) {
+  Step *step = &workflow->steps[index];
+  step->state = STEP_RUNNING;
+  step->watcher = (JobWatcher) {stepFinished, step};
+  if (workflow->cancelled || panelClosed(workflow->root->panel)) {
+    settleStep(workflow, index, false);
+  } else if (step->command->command == NULL) {
+    settleStep(workflow, index, true); /* A 'run' button, it only gathers up its prerequisites. */
+  } else if (!runStep(step->command, &step->watcher)) {
+    settleStep(workflow, index, false);
+  }
+}
+
+static void advance(Workflow *workflow) {
+  /* Steps that settle as soon as they're launched make more steps ready, so only the outermost call loops. */
+  if (workflow->advancing) return;
+  workflow->advancing = true;
+  while (workflow->readyStart < workflow->readyEnd) launchStep(workflow, workflow->ready[workflow->readyStart++]);
+  workflow->advancing = false;
+
+  if (workflow->unfinished == 0) {
+    Command *root = workflow->root;
+    if (root->latestWorkflow == workflow) root->latestWorkflow = NULL;
+    freeWorkflow(workflow);
+    workflowEnded(root);
+  }
+}
+
+bool startWorkflow(Command *command) {
+  Workflow *workflow = buildWorkflow(command);
+  if (workflow == NULL) return false;
+  command->latestWorkflow = workflow;
+  advance(workflow);
+  return true;
+}
+
+void cancelWorkflow(Workflow *workflow) {
+  /* A queued step is settled on the spot, so hold off advancing until every running step has been dealt with. */
+  workflow->cancelled = true;
+  workflow->root->latestWorkflow = NULL;
+  workflow->advancing = true;
+  for (int i = 0; i < workflow->count; i++) {
+    if (workflow->steps[i].state == STEP_RUNNING) cancelStep(&workflow->steps[i].watcher);
+  }
+  workflow->advancing = false;
+  advance(workflow);
+}
+
+int runHeadlessWorkflow(Command *command) {
+  Workflow *workflow = buildWorkflow(command);
+  if (workflow == NULL) return EX_DATAERR;
+
+  int result = 0;
+  while (workflow->readyStart < workflow->readyEnd) {
+    int index = workflow->ready[workflow->readyStart++];
+    Command *step = workflow->steps[index].command;
+    int status = step->command == NULL ? 0 : runHeadless(step);
+    if (status != 0 && result == 0) result = status;
+    settleStep(workflow, index, status == 0);
+  }
+  freeWorkflow(workflow);
+  return result;
+}
@@ -0,0 +1,21 @@
+#ifndef SGIDLS_WORKFLOW
+#define SGIDLS_WORKFLOW
+
+#include <stdbool.h>
+
+#include "job.h"
+
+/* Runs a button along with everything it comes 'after', each step as soon as its prerequisites have succeeded.
+   Steps that don't depend on each other run side by side, as far as the job limit allows. A step that fails
+   takes everything after it down with it, the rest of the workflow carries on. */
+extern bool startWorkflow(Command *command);
+
+/* Stops a workflow for a restart: its running steps are killed and the rest never run. Quietly, the skipped steps
+   aren't reported. */
+extern void cancelWorkflow(Workflow *workflow);
+
+/* The same without a main loop: one step at a time, in an order that respects 'after'. Returns the status of
+   the first step that failed, or 0. */
+extern int runHeadlessWorkflow(Command *command);
+
+#endif